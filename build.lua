@@ -1,15 +1,23 @@
 tool 'bltc' {
-   app {
-      icon 'icon/bengine-warm.ico',
+   lib '-compiler' {
+      src 'src/*.cpp',
       link_project {
          'core',
          'core-id-with-names',
          'util',
          'util-fs',
          'util-string',
+         'blt',
+         'lua'
+      }
+   },
+   app {
+      icon 'icon/bengine-warm.ico',
+      src 'src-cli/*.cpp',
+      link_project {
+         'bltc-compiler',
          'cli',
-         'ctable',
-         'blt'
+         'ctable'
       }
    }
 }
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef BE_BLTC_API_HPP_
+#define BE_BLTC_API_HPP_
+
+#include "driver.hpp"
+#include <stdexcept>
+
+// These functions are provided by the bltc-compiler library.  The core
+// library must be initialized (e.g. by a CoreInitLifecycle) while they are
+// used.
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Thrown by compile_file() when its input can't be read (status 4)
+///         or compiled (6), or its output can't be written (5).
+class CompileFileError final : public std::runtime_error {
+public:
+   CompileFileError(I8 status, const S& message)
+      : std::runtime_error(message),
+        status_(status) { }
+
+   I8 status() const noexcept { return status_; }
+
+private:
+   I8 status_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Compiles a BLT template to Lua source code.
+///
+/// \details Throws if the template can't be compiled.  Compiler state is
+///         reused by later calls on the same thread.  Includes are only
+///         inlined if options.resolve_include is set.
+S compile_buffer(const S& source, const CodegenOptions& options = CodegenOptions());
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Compiles a BLT file to a Lua file.
+///
+/// \details Throws CompileFileError if the input can't be read or compiled,
+///         or the output can't be written.  Missing parent directories of
+///         the output are created.
+void compile_file(const Path& input, const Path& output, const CodegenOptions& options = CodegenOptions());
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Compiles a batch of (input, output) files.
+///
+/// \details Returns the same status bltc would exit with.  An empty output
+///         path selects the default output for that input.
+I8 compile_batch(const std::vector<std::pair<Path, Path>>& files, Driver::Options options);
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef BE_BLTC_BENCH_HPP_
+#define BE_BLTC_BENCH_HPP_
+
+#include "renderer.hpp"
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+struct BenchResult {
+   std::size_t renders = 0;
+   std::size_t output_size = 0; // bytes written by each render
+   double render_seconds = 0;
+   double gc_seconds = 0;
+   std::size_t allocations = 0;
+   std::size_t bytes = 0;
+};
+
+BenchResult benchmark(Renderer& renderer, const LuaAllocStats& stats, std::size_t renders);
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef BE_BLTC_BUNDLE_HPP_
+#define BE_BLTC_BUNDLE_HPP_
+
+#include <be/core/be.hpp>
+#include <ostream>
+#include <unordered_map>
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Collects compiled templates and writes them as a single Lua
+///         module.
+///
+/// \details The module returns a table mapping each template's name to its
+///         chunk function.  The sources of all templates are stored in one
+///         long string, and a template is only parsed (using the offset and
+///         length recorded in an index) the first time it is looked up.
+///
+///         If interning is enabled, string literals that appear more than
+///         once across all templates are stored once in a shared constant
+///         table, which the templates that use them receive when loaded.
+class Bundle final {
+public:
+   void intern(std::size_t min_length);
+   void add(const S& name, const S& lua);
+   std::size_t size() const;
+   void write(std::ostream& os) const;
+
+private:
+   struct Entry {
+      S name;
+      std::size_t offset;
+      std::size_t length;
+      bool interned;
+   };
+
+   void intern_(std::vector<Entry>& entries, S& sources, std::vector<S>& constants) const;
+
+   std::size_t intern_min_length_ = 0;
+   std::vector<Entry> entries_;
+   std::unordered_map<S, std::size_t> names_;
+   S sources_;
+};
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef BE_BLTC_C_API_H_
+#define BE_BLTC_C_API_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * These functions are provided by the bltc-compiler library, which the bltc
+ * executable is also built on.  They initialize the core library themselves.
+ *
+ * Functions return 0 on success, or the same status code bltc would exit
+ * with.  On failure, if error is non-null, *error receives a description of
+ * the problem, which must be released with bltc_free().  Strings are UTF-8.
+ */
+
+typedef struct bltc_options {
+   size_t size;                     /* sizeof(bltc_options); set by bltc_options_init() */
+   const char* writer;              /* name of the writer function; "write" if null */
+   const char* include_function;    /* calls to this function are inlined; disabled if null */
+   int optimize;                    /* nonzero enables all optimization passes */
+   int buffer_output;               /* nonzero selects the buffer emit strategy */
+   const char* const* search_paths; /* used to resolve includes; the working directory if empty */
+   size_t search_path_count;
+} bltc_options;
+
+void bltc_options_init(bltc_options* options);
+
+int bltc_compile_buffer(const char* source, size_t source_size, const bltc_options* options,
+                        char** output, size_t* output_size, char** error);
+
+int bltc_compile_file(const char* input, const char* output, const bltc_options* options, char** error);
+
+/* outputs may be null, or contain nulls, to use the default output paths.
+ * Errors from every input are collected into *error, one per line. */
+int bltc_compile_batch(const char* const* inputs, const char* const* outputs, size_t count,
+                       const bltc_options* options, char** error);
+
+void bltc_free(void* ptr);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+#ifndef BE_BLTC_COMPILER_HPP_
+#define BE_BLTC_COMPILER_HPP_
+
+#include <be/core/filesystem.hpp>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+
+namespace be {
+namespace bltc {
+
+class LuaState;
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Appends everything written to it to an external string.
+class StringBuffer final : public std::streambuf {
+public:
+   explicit StringBuffer(S& str) : str_(str) { }
+
+protected:
+   int_type overflow(int_type c) override;
+   std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+private:
+   S& str_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Discards everything written to it.
+class NullBuffer final : public std::streambuf {
+protected:
+   int_type overflow(int_type c) override;
+   std::streamsize xsputn(const char* s, std::streamsize n) override;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Options controlling post-processing of the Lua code generated by
+///         the BLT compiler.
+struct CodegenOptions {
+   enum class Strategy { direct, buffer };
+   enum class Target { lua, luajit };
+
+   S writer = "write";
+   S include_function; // inlining is disabled if empty
+   std::size_t inline_max_size = 0;
+   std::function<bool(const S&, Path&)> resolve_include;
+   std::vector<std::pair<S, S>> defines; // global name -> Lua literal
+   bool coalesce_writes = false;
+   bool hoist_globals = false;
+   std::vector<S> hoist_names;
+   Strategy strategy = Strategy::direct;
+   Target target = Target::lua;
+   bool string_buffer = false; // requires the luajit target
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Runs the BLT compiler on one input at a time, reusing its input
+///         and output storage and streams from one job to the next.
+///
+/// \details Use Compiler::for_thread() rather than creating a new compiler
+///         for each job.  Returned references are only valid until the next
+///         call that replaces the same buffer.
+class Compiler final {
+public:
+   Compiler();
+   Compiler(const Compiler&) = delete;
+   Compiler& operator=(const Compiler&) = delete;
+   ~Compiler();
+
+   const S& load(const Path& path);
+   void clear_input();
+   const S& input() const;
+
+   const S& compile(const S& input, const CodegenOptions& options = CodegenOptions());
+   void compile(const S& input, const CodegenOptions& options, std::ostream& os);
+   const S& generate(const S& input);
+   const S& optimize(const S& generated, const CodegenOptions& options);
+   const S& debug(const S& input);
+   void check(const S& input);
+   const S& dump(const S& lua, const S& chunk_name, bool strip);
+   const std::vector<Path>& dependencies() const;
+   void reset();
+
+   static Compiler& for_thread();
+
+private:
+   void optimize_(const CodegenOptions& options);
+   struct Include {
+      S lua;
+      std::vector<Path> dependencies; // templates inlined into this one
+   };
+
+   void inline_includes_(const S& source, S& out, const CodegenOptions& options, std::vector<Path>& stack,
+                         std::vector<Path>& dependencies);
+   const Include* load_include_(const Path& path, const CodegenOptions& options, std::vector<Path>& stack);
+
+   S input_;
+   S generated_;
+   S output_;
+   S scratch_;
+   S bytecode_;
+   StringBuffer output_buf_;
+   std::ostream output_os_;
+   NullBuffer null_buf_;
+   std::ostream null_os_;
+   std::unique_ptr<LuaState> lua_;
+   std::vector<Path> dependencies_;
+   std::unordered_map<S, Include> includes_; // by path
+};
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+#ifndef BE_BLTC_CPP_BACKEND_HPP_
+#define BE_BLTC_CPP_BACKEND_HPP_
+
+#include "source_map.hpp"
+
+namespace be {
+namespace bltc {
+
+S cpp_identifier(const S& name);
+void generate_cpp(const S& lua, const S& writer, const S& function_name, const S& source_name,
+                  const std::vector<SourceLocation>& lines, S& out);
+
+} // be::bltc
+} // be
+
+#endif
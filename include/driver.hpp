@@ -0,0 +1,129 @@
+#pragma once
+#ifndef BE_BLTC_DRIVER_HPP_
+#define BE_BLTC_DRIVER_HPP_
+
+#include "compiler.hpp"
+#include "bundle.hpp"
+#include "renderer.hpp"
+#include "search_path_index.hpp"
+#include <be/core/filesystem.hpp>
+#include <array>
+#include <exception>
+#include <memory>
+
+namespace be {
+namespace bltc {
+
+const std::size_t default_inline_max_size = 4096;
+
+// Lua 5.2 and later already share strings up to 40 bytes long once loaded
+// (Lua 5.1 and LuaJIT share all strings, but only after parsing them).
+const std::size_t default_intern_min_length = 41;
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Resolves, compiles, and writes the outputs of a batch
+///         of jobs.
+///
+/// \details This is everything bltc does after parsing its command line, so
+///         other tools can do the same work in-process.  Errors are logged
+///         (or passed to Options::on_error) and reflected in the returned
+///         status, which uses the same codes as bltc's exit code: 0 (no
+///         errors), 1 (unknown error), 3 (input not found), 4 (read error),
+///         5 (write error), 6 (compile error), or 7 (Lua error while
+///         rendering).  When there are several errors, the highest code is
+///         returned.  The core library must be initialized (e.g. by a
+///         CoreInitLifecycle) while a Driver is in use.
+class Driver final {
+public:
+   enum class Artifact { lua, bytecode, cpp, tree, count_ };
+   enum class SourceType { path, raw, console, frames };
+   enum class DestType { path, console, bundle };
+
+   struct Job {
+      S source;
+      S dest;
+      SourceType source_type;
+      DestType dest_type;
+      std::array<S, (std::size_t)Artifact::count_> artifact_dests;
+   };
+
+   struct Variant {
+      S name;
+      CodegenOptions codegen;
+   };
+
+   struct Options {
+      Options();
+
+      std::array<bool, (std::size_t)Artifact::count_> emit = {{ true, false, false, false }};
+      bool strip_bytecode = false;
+      bool source_map = false;
+      bool check = false;
+      bool run = false;
+      std::size_t bench_renders = 0;
+      RenderOptions render;
+      Path data_path;
+      CodegenOptions codegen;
+      std::vector<Variant> variants;
+      S variant_pattern = "{name}.{variant}.{ext}";
+      std::vector<Path> search_paths; // the working directory if empty
+      Path output_path;
+      S bundle_dest;
+      std::size_t intern_min_length = default_intern_min_length;
+      S depfile_dest;
+      std::function<void(const S& source, I8 status, const S& message)> on_error; // errors are logged if empty
+      std::ostream* console = nullptr; // receives output for DestType::console; std::cout if null
+   };
+
+   Driver(Options options, std::vector<Job> jobs);
+   Driver(const Driver&) = delete;
+   Driver& operator=(const Driver&) = delete;
+
+   I8 operator()();
+
+private:
+   struct Task {
+      Job job;
+      Path path;
+      const S* data = nullptr;
+      S output; // compiled code for DestType::bundle, or benchmark results
+      std::vector<S> targets;
+      std::vector<Path> dependencies;
+      std::vector<Path> dests; // files written, once execute_() returns
+      std::vector<std::pair<I8, std::exception_ptr>> errors;
+   };
+
+   void process_(Job& job);
+   void process_path_(const Path& path, Job& job);
+   void process_frames_(const Job& job);
+   void process_non_path_(const S& data, Job& job);
+   void submit_(Task& task);
+   void execute_(Task& task) const;
+   void compile_(Task& task, Compiler& compiler) const;
+   void render_(Task& task, Compiler& compiler, const S& data) const;
+   void bench_(Task& task, Compiler& compiler, const S& data) const;
+   void finish_(Task& task);
+   void error_(const S& source, I8 status, const std::exception_ptr& error);
+   void write_bundle_();
+   void add_dependencies_(const std::vector<S>& targets, const std::vector<Path>& prerequisites);
+   void write_depfile_();
+   S bundle_name_(const Path& path) const;
+   S chunk_name_(const Task& task) const;
+   Artifact primary_artifact_() const;
+   DestType artifact_dest_(const Job& job, Artifact artifact, S& dest, const Variant* variant = nullptr) const;
+
+   Options options_;
+   std::vector<Job> jobs_;
+   I8 status_ = 0;
+   SearchPathIndex search_index_;
+   Bundle bundle_;
+   S depfile_;
+   std::vector<Path> bundle_dependencies_;
+   std::ostream* console_;
+   S* frame_log_ = nullptr; // collects errors for the current frame's response
+};
+
+} // be::bltc
+} // be
+
+#endif
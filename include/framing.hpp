@@ -0,0 +1,66 @@
+#pragma once
+#ifndef BE_BLTC_FRAMING_HPP_
+#define BE_BLTC_FRAMING_HPP_
+
+#include <be/core/be.hpp>
+#include <istream>
+#include <ostream>
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Frames are a 4-byte little-endian payload length followed by the
+///         payload itself.
+///
+/// \details Frames larger than this are rejected, so a corrupt length can't
+///         make the reader try to allocate an absurd amount of memory.
+const std::size_t max_frame_size = 1u << 30;
+
+bool read_frame(std::istream& is, S& payload);
+void write_frame(std::ostream& os, const S& payload);
+
+void append_u32(S& out, U32 value);
+U32 read_u32(const S& data, std::size_t offset);
+
+void set_binary_stdio();
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Takes over the process's standard output for writing frames
+///         until destroyed.
+///
+/// \details stream() writes to a duplicate of the original stdout file
+///         descriptor, and stdout itself is pointed at stderr, so nothing
+///         else in the process (std::cout, printf, or a log sink) can write
+///         into the middle of a frame.
+class FrameOutput final {
+public:
+   FrameOutput();
+   FrameOutput(const FrameOutput&) = delete;
+   FrameOutput& operator=(const FrameOutput&) = delete;
+   ~FrameOutput();
+
+   std::ostream& stream() { return os_; }
+
+private:
+   class Buffer final : public std::streambuf {
+   public:
+      explicit Buffer(int fd) : fd_(fd) { }
+
+   protected:
+      int_type overflow(int_type c) override;
+      std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+   private:
+      int fd_;
+   };
+
+   int fd_;
+   Buffer buf_;
+   std::ostream os_;
+};
+
+} // be::bltc
+} // be
+
+#endif
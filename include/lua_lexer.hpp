@@ -0,0 +1,46 @@
+#pragma once
+#ifndef BE_BLTC_LUA_LEXER_HPP_
+#define BE_BLTC_LUA_LEXER_HPP_
+
+#include <be/core/be.hpp>
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+enum class LuaTokenType {
+   name,
+   keyword,
+   number,
+   string,
+   symbol
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  A single token of Lua source code.
+///
+/// \details Tokens store offsets into the source they were lexed from.  Any
+///         whitespace and comments between the previous token and this one
+///         start at offset trivia.
+struct LuaToken {
+   LuaTokenType type;
+   std::size_t trivia;
+   std::size_t begin;
+   std::size_t end;
+};
+
+std::vector<LuaToken> lex_lua(const S& source);
+
+bool is_token(const S& source, const LuaToken& token, const char* text);
+bool is_token(const S& source, const LuaToken& token, const S& text);
+S token_text(const S& source, const LuaToken& token);
+
+S decode_lua_string(const S& source, const LuaToken& token);
+void append_lua_string(S& out, const S& value);
+
+std::size_t count_newlines(const S& source, std::size_t begin, std::size_t end);
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+#ifndef BE_BLTC_LUA_PASSES_HPP_
+#define BE_BLTC_LUA_PASSES_HPP_
+
+#include <be/core/be.hpp>
+#include <functional>
+#include <unordered_map>
+
+namespace be {
+namespace bltc {
+
+void inline_includes(const S& source, S& out, const S& include_fn, const std::function<bool(const S&, S&)>& load,
+                     std::vector<S>& inlined);
+void apply_defines(const S& source, S& out, const std::vector<std::pair<S, S>>& defines);
+void coalesce_writes(const S& source, S& out, const S& writer);
+void hoist_globals(const S& source, S& out, const S& writer, const std::vector<S>& extra_names);
+bool buffer_writes(const S& source, S& out, const S& writer, bool string_buffer);
+void find_strings(const S& source, std::size_t min_length, std::vector<S>& values);
+bool intern_strings(const S& source, S& out, const std::unordered_map<S, std::size_t>& constants, const S& table);
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef BE_BLTC_LUA_STATE_HPP_
+#define BE_BLTC_LUA_STATE_HPP_
+
+#include <be/core/be.hpp>
+#include <memory>
+#include <stdexcept>
+
+struct lua_State;
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Thrown when the embedded Lua interpreter reports an error.
+class LuaError final : public std::runtime_error {
+public:
+   using std::runtime_error::runtime_error;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Running totals of the memory allocated by a LuaState.
+struct LuaAllocStats {
+   std::size_t allocations = 0;
+   std::size_t bytes = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Owns an embedded Lua interpreter.
+///
+/// \details A LuaState may only be used by one thread at a time.  If stats
+///         is provided, every allocation made by the interpreter after it is
+///         created is added to it.
+class LuaState final {
+public:
+   explicit LuaState(LuaAllocStats* stats = nullptr);
+   LuaState(const LuaState&) = delete;
+   LuaState& operator=(const LuaState&) = delete;
+   ~LuaState();
+
+   lua_State* get() const;
+
+   void open_libs();
+   void load(const S& source, const S& chunk_name);
+   void call(int nargs, int nresults);
+   void dump(S& out, bool strip);
+
+private:
+   struct Allocator;
+
+   lua_State* L_;
+   std::unique_ptr<Allocator> allocator_;
+};
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef BE_BLTC_RENDERER_HPP_
+#define BE_BLTC_RENDERER_HPP_
+
+#include "lua_state.hpp"
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+struct RenderOptions {
+   S writer = "write";
+   S data; // Lua chunk returning a table of globals
+   S data_chunk_name;
+   std::vector<std::pair<S, S>> globals; // name, Lua literal
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Runs compiled templates in an embedded Lua interpreter and
+///         captures their output.
+///
+/// \details Each Renderer has its own Lua state with the standard libraries
+///         open, the writer function installed, and the globals from the
+///         data chunk and RenderOptions::globals set, in that order.  Globals
+///         changed by a template are not reset between renders.
+class Renderer final {
+public:
+   explicit Renderer(const RenderOptions& options, LuaAllocStats* stats = nullptr);
+
+   LuaState& lua();
+
+   void load(const S& lua, const S& chunk_name);
+   void render(S& out);
+
+private:
+   LuaState lua_;
+   S* out_ = nullptr;
+   bool loaded_ = false;
+};
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef BE_BLTC_SEARCH_PATH_INDEX_HPP_
+#define BE_BLTC_SEARCH_PATH_INDEX_HPP_
+
+#include <be/core/filesystem.hpp>
+#include <unordered_map>
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Resolves input patterns against a list of search paths, caching
+///         directory listings and previous results.
+///
+/// \details Each directory is read at most once, the first time a pattern
+///         needs it.  Later lookups of plain (non-wildcard) paths are answered
+///         from that listing, including misses, so repeating a lookup across
+///         many search paths doesn't cost a stat per search path per input.
+///         Patterns containing wildcards are forwarded to util::glob and the
+///         result is memoized.
+///
+///         Nothing watches the file system, so the owner must call
+///         invalidate() for every directory it writes to.  The index lives
+///         as long as the Driver that owns it, so a persistent worker builds
+///         a new one for every request and never sees stale listings from
+///         files changed between requests.  Not safe to use from multiple
+///         threads.
+class SearchPathIndex final {
+public:
+   explicit SearchPathIndex(const std::vector<Path>& search_paths);
+
+   std::vector<Path> resolve(const S& pattern);
+   void invalidate(const Path& dir);
+
+private:
+   using DirEntries = std::unordered_map<S, bool>; // name -> is directory
+
+   const DirEntries& dir_(const Path& dir);
+
+   const std::vector<Path>& search_paths_;
+   std::unordered_map<S, DirEntries> dirs_;
+   std::unordered_map<S, std::vector<Path>> globs_;
+};
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef BE_BLTC_SOURCE_MAP_HPP_
+#define BE_BLTC_SOURCE_MAP_HPP_
+
+#include <be/core/be.hpp>
+#include <ostream>
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  A 1-based line and byte column in a template.  Line 0 means
+///         unknown.
+struct SourceLocation {
+   std::size_t line = 0;
+   std::size_t column = 0;
+};
+
+std::vector<SourceLocation> map_source_lines(const S& lua, const S& writer, const S& source);
+void write_source_map(std::ostream& os, const S& source_name, const std::vector<SourceLocation>& lines);
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,802 @@
+#include "bltc_app.hpp"
+#include "version.hpp"
+#include "lua_lexer.hpp"
+#include "framing.hpp"
+#include <be/core/version.hpp>
+#include <be/blt/version.hpp>
+#include <be/cli/cli.hpp>
+#include <be/core/logging.hpp>
+#include <be/core/log_exception.hpp>
+#include <be/util/path_glob.hpp>
+#include <iostream>
+#include <algorithm>
+
+namespace be {
+namespace bltc {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_single_token(const S& str, LuaTokenType type) {
+   try {
+      std::vector<LuaToken> tokens = lex_lua(str);
+      return tokens.size() == 1 && tokens[0].type == type && tokens[0].begin == 0 && tokens[0].end == str.size();
+   } catch (const std::runtime_error&) {
+      return false;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Parses KEY=VALUE (or just KEY, meaning KEY=true) into a global name and
+/// a Lua literal.  true, false, nil, and numbers are used as-is; anything
+/// else is a string.
+std::pair<S, S> parse_define(const S& str) {
+   std::size_t eq = str.find('=');
+   S name = str.substr(0, eq);
+   if (!is_single_token(name, LuaTokenType::name)) {
+      throw std::runtime_error("Invalid define name: " + name);
+   }
+
+   if (eq == S::npos) {
+      return { name, "true" };
+   }
+
+   S value = str.substr(eq + 1);
+   if (value == "true" || value == "false" || value == "nil" || is_single_token(value, LuaTokenType::number)) {
+      return { name, value };
+   }
+
+   if (value.size() > 1 && value[0] == '-' && is_single_token(value.substr(1), LuaTokenType::number)) {
+      return { name, "(" + value + ")" };
+   }
+
+   S literal;
+   append_lua_string(literal, value);
+   return { name, literal };
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+BltcApp::BltcApp(int argc, char** argv) {
+   default_log().verbosity_mask(v::info_or_worse);
+   parse_(argc, argv);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int BltcApp::operator()() {
+   if (status_ != 0) {
+      return status_;
+   }
+
+   if (persistent_worker_) {
+      return run_worker_();
+   }
+
+   if (!driver_) {
+      // only help or version information was requested
+      return status_;
+   }
+
+   return (*driver_)();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Parses a command line into options_ and jobs_, and creates the driver
+/// unless only help or version information was requested.  Help and
+/// output sent to stdout go to console_ if it is set, and errors are
+/// passed to on_error_ if it is set.
+void BltcApp::parse_(int argc, char** argv) {
+   options_.console = console_;
+   options_.on_error = on_error_;
+   try {
+      using namespace cli;
+      using namespace color;
+      using namespace ct;
+      Processor proc;
+
+      S dest;
+      DestType dest_type = DestType::path;
+      S bytecode_dest;
+      S cpp_dest;
+      S tree_dest;
+      std::vector<std::pair<S, std::vector<std::pair<S, S>>>> variant_specs;
+
+      bool show_version = false;
+      bool show_help = false;
+      bool verbose = false;
+      S help_query;
+
+      proc
+         (prologue (Table() << header << "BLT COMPILER").query())
+
+         (synopsis (Cell() << fg_dark_gray << "[ " << fg_cyan << "OPTIONS"
+                           << fg_dark_gray << " ] [ " << fg_cyan << "INPUT"
+                           << fg_dark_gray << " [ " << fg_cyan << "INPUT"
+                           << fg_dark_gray << " ...]]"))
+
+         (abstract ("BLTC compiles Backtick Lua Template (BLT) files to Lua source code."))
+
+         (abstract ("By default file inputs will be compiled to a file of the same name with extension '.lua'. "
+                    "When processing non-file inputs, the output will be sent to stdout by default.").verbose())
+
+         (param ({ "o" },{ "output" }, "PATH", [&](const S& str) {
+               dest = str;
+               dest_type = DestType::path;
+            }).desc("Specifies an output path where the next compiled input should be saved.")
+              .extra(Cell() << nl << "Must be specified before the input it affects.  Only a single input will be affected.  "
+                                     "Relative paths will be resolved based on the path specified by "
+                            << fg_yellow << "--output-dir" << reset
+                            << " or the working directory.  If the specified file does not exist, it will be created; "
+                               "otherwise it will be overwritten."))
+
+         (param ({ },{ "bundle" }, "PATH", [&](const S& str) {
+               options_.bundle_dest = str;
+            }).desc("Compiles all file inputs into a single Lua module.")
+              .extra(Cell() << nl << "The module returns a table that maps the name of each template to its compiled "
+                                     "chunk.  Names are the input paths relative to the search path where they were found, "
+                                     "without extension, using '/' as a separator.  Each template is only parsed the first "
+                                     "time it is looked up.  Relative paths are resolved the same way as for "
+                            << fg_yellow << "--output" << reset << ".  Applies to all file inputs, including those that "
+                               "were specified earlier on the command line; per-input output options and "
+                            << fg_yellow << "--emit" << reset << " are ignored for them.  Other inputs are compiled "
+                               "normally."))
+
+         (param ({ },{ "intern" }, "MIN_LENGTH", [&](const S& str) {
+               options_.intern_min_length = (std::size_t)std::stoul(str);
+            }).desc("Specifies the minimum length of string literals that are shared between templates in a bundle.")
+              .extra(Cell() << nl << "When writing a bundle (see " << fg_yellow << "--bundle" << reset << "), string "
+                               "literals of at least " << fg_cyan << "MIN_LENGTH" << reset << " bytes that appear more "
+                               "than once are stored only once, in a constant table shared by all templates.  Defaults to "
+                            << fg_cyan << default_intern_min_length << reset << "; shorter strings are already shared "
+                               "by Lua itself.  0 disables sharing."))
+
+         (flag ({ },{ "stdout" }, dest_type, DestType::console)
+            .desc("Outputs the next compiled input to standard output.")
+            .extra(Cell() << nl << "Must be specified before the input it affects.  Only a single input will be affected."))
+
+         (param ({ },{ "bytecode-output" }, "PATH", [&](const S& str) {
+               bytecode_dest = str;
+            }).desc("Specifies an output path where the Lua bytecode for the next input should be saved.")
+              .extra(Cell() << nl << "Must be specified before the input it affects.  Only a single input will be affected.  "
+                                     "Relative paths are resolved the same way as for "
+                            << fg_yellow << "--output" << reset << ".  If not specified and bytecode is emitted alongside "
+                               "compiled output (see " << fg_yellow << "--emit" << reset << "), the bytecode is saved next to "
+                               "the compiled output, with the extension '.luac'."))
+
+         (param ({ },{ "cpp-output" }, "PATH", [&](const S& str) {
+               cpp_dest = str;
+            }).desc("Specifies an output path where the C++ code for the next input should be saved.")
+              .extra(Cell() << nl << "Must be specified before the input it affects.  Only a single input will be affected.  "
+                                     "Relative paths are resolved the same way as for "
+                            << fg_yellow << "--output" << reset << ".  If not specified and C++ code is emitted alongside "
+                               "compiled output (see " << fg_yellow << "--emit" << reset << "), it is saved next to "
+                               "the compiled output, with the extension '.hpp'."))
+
+         (param ({ },{ "tree-output" }, "PATH", [&](const S& str) {
+               tree_dest = str;
+            }).desc("Specifies an output path where the parse tree for the next input should be saved.")
+              .extra(Cell() << nl << "Must be specified before the input it affects.  Only a single input will be affected.  "
+                                     "Relative paths are resolved the same way as for "
+                            << fg_yellow << "--output" << reset << ".  If not specified and parse trees are emitted alongside "
+                               "compiled output (see " << fg_yellow << "--emit" << reset << "), the parse tree is saved next to "
+                               "the compiled output, with the extension '.tree'."))
+
+         (flag ({ },{ "debug" }, [&]() {
+               options_.emit.fill(false);
+               options_.emit[(std::size_t)Artifact::tree] = true;
+            }).desc("Outputs parse trees instead of the compiled output.")
+              .extra(Cell() << nl << "Equivalent to " << fg_yellow << "--emit tree" << reset << ".  Applies to all inputs, "
+                                     "including those that were specified earlier on the command line."))
+
+         (param ({ },{ "emit" }, "LIST", [&](const S& str) {
+               options_.emit.fill(false);
+               std::size_t begin = 0;
+               while (begin <= str.size()) {
+                  std::size_t end = std::min(str.find(',', begin), str.size());
+                  S artifact = str.substr(begin, end - begin);
+                  if (artifact == "lua") {
+                     options_.emit[(std::size_t)Artifact::lua] = true;
+                  } else if (artifact == "bytecode") {
+                     options_.emit[(std::size_t)Artifact::bytecode] = true;
+                  } else if (artifact == "cpp") {
+                     options_.emit[(std::size_t)Artifact::cpp] = true;
+                  } else if (artifact == "tree") {
+                     options_.emit[(std::size_t)Artifact::tree] = true;
+                  } else {
+                     throw std::runtime_error("Unrecognized artifact type: " + artifact);
+                  }
+                  begin = end + 1;
+               }
+            }).desc("Specifies which artifacts should be generated for each input, each with its own destination.")
+              .extra(Cell() << nl << fg_cyan << "LIST" << reset << " is a comma-separated list containing "
+                            << fg_cyan << "lua" << reset << " (compiled Lua source), "
+                            << fg_cyan << "bytecode" << reset << " (precompiled Lua bytecode), "
+                            << fg_cyan << "cpp" << reset << " (a C++ function template; see below) and/or "
+                            << fg_cyan << "tree" << reset << " (parse tree).  Defaults to "
+                            << fg_cyan << "lua" << reset << ".  Each input is loaded only once regardless of how "
+                               "many artifacts are generated.  The first artifact in the order above is saved to the normal "
+                               "output path; the others are saved according to their own output options.  When the output "
+                               "is standard output, only one artifact may lack its own output path.  This saves resolving and "
+                               "loading inputs again, but the BLT library still parses each input once for the parse tree and "
+                               "once for everything else.  Applies to all "
+                               "inputs, including those that were specified earlier on the command line."
+                            << nl << nl << "The C++ backend only supports templates made up of literal text, "
+                               "writes of simple expressions over global variables and their fields, "
+                            << fg_cyan << "if" << reset << " statements, numeric " << fg_cyan << "for" << reset
+                            << " loops, and " << fg_cyan << "ipairs" << reset << " loops over arrays (after applying "
+                            << fg_yellow << "--define" << reset << " and " << fg_yellow << "--inline" << reset
+                            << "); any other code is reported as an error.  The generated header defines " << fg_cyan << "template <typename Buffer, "
+                               "typename Context> void NAME(Buffer& out, const Context& ctx)" << reset << ", where "
+                            << fg_cyan << "NAME" << reset << " is derived from the input file name (or is "
+                            << fg_cyan << "render" << reset << " for other inputs), plus the variant name.  "
+                               "Globals are read as " << fg_cyan << "ctx.name" << reset << ", and arrays must support "
+                            << fg_cyan << "std::size" << reset << " and " << fg_cyan << "operator[]" << reset << ".  "
+                               "Literal text is written with " << fg_cyan << "out.write(data, size)" << reset << ", "
+                               "numbers and bools are formatted as Lua's " << fg_cyan << "tostring" << reset << " would "
+                               "(depending on whether their C++ type is an integer), and other values are written with "
+                            << fg_cyan << "out << value" << reset << ", so a " << fg_cyan << "std::ostream" << reset
+                            << " can be used as the buffer.  Conditions are evaluated as in C++, so numbers and strings "
+                               "should be compared explicitly."))
+
+         (flag ({ },{ "strip" }, options_.strip_bytecode)
+            .desc("Removes debug information from emitted Lua bytecode.")
+            .extra(Cell() << nl << "Stripped bytecode is smaller and loads faster, but error messages and tracebacks "
+                                   "raised by it won't include line numbers.  Has no effect unless bltc was built with "
+                                   "Lua 5.3 or later.  Applies to all inputs, including those that were specified earlier "
+                                   "on the command line."))
+
+         (flag ({ },{ "source-map" }, options_.source_map)
+            .desc("Writes a map from generated Lua lines to template lines next to each output file.")
+            .extra(Cell() << nl << "The map is saved with '.map' appended to the name of the Lua or bytecode output "
+                                   "it describes.  Its first line is " << fg_cyan << "bltc-source-map 1" << reset
+                            << ", followed by " << fg_cyan << "source PATH" << reset << ".  Each remaining line has the "
+                               "form " << fg_cyan << "LUA_LINE TEMPLATE_LINE:COLUMN" << reset << ", or " << fg_cyan
+                            << "LUA_LINE -" << reset << " for lines that couldn't be mapped, and applies to the "
+                               "generated lines from " << fg_cyan << "LUA_LINE" << reset << " up to the next entry.  "
+                               "The mapping is heuristic: it is guessed by locating the text and code of each generated "
+                               "line in the template, near the previous match, so it can be wrong when the same text "
+                               "appears repeatedly, and some lines may be left unmapped.  No map is written "
+                               "for outputs sent to standard output or added to a bundle.  Applies to all inputs, "
+                               "including those that were specified earlier on the command line."))
+
+         (param ({ "O" },{ "optimize" }, "LIST", [&](const S& str) {
+               std::size_t begin = 0;
+               while (begin <= str.size()) {
+                  std::size_t end = std::min(str.find(',', begin), str.size());
+                  S pass = str.substr(begin, end - begin);
+                  if (pass == "all") {
+                     options_.codegen.coalesce_writes = true;
+                     options_.codegen.hoist_globals = true;
+                  } else if (pass == "none") {
+                     options_.codegen.coalesce_writes = false;
+                     options_.codegen.hoist_globals = false;
+                  } else if (pass == "coalesce") {
+                     options_.codegen.coalesce_writes = true;
+                  } else if (pass == "hoist") {
+                     options_.codegen.hoist_globals = true;
+                  } else {
+                     throw std::runtime_error("Unrecognized optimization: " + pass);
+                  }
+                  begin = end + 1;
+               }
+            }).desc("Enables optimization passes on the generated Lua code.")
+              .extra(Cell() << nl << fg_cyan << "LIST" << reset << " is a comma-separated list containing any of: "
+                            << nl << fg_cyan << "coalesce" << reset << " - merges consecutive writes of literal text into a single write"
+                            << nl << fg_cyan << "hoist" << reset << " - binds standard library globals (and any specified with "
+                            << fg_yellow << "--hoist" << reset << ") that are used more than once to locals at the top of the chunk"
+                            << nl << fg_cyan << "all" << reset << " - enables all of the above"
+                            << nl << fg_cyan << "none" << reset << " - disables all optimizations (the default)"
+                            << nl << "Optimizations never move code to a different line.  Applies to all inputs, including "
+                                     "those that were specified earlier on the command line."))
+
+         (param ({ },{ "hoist" }, "LIST", [&](const S& str) {
+               std::size_t begin = 0;
+               while (begin <= str.size()) {
+                  std::size_t end = std::min(str.find(',', begin), str.size());
+                  if (end > begin) {
+                     options_.codegen.hoist_names.push_back(str.substr(begin, end - begin));
+                  }
+                  begin = end + 1;
+               }
+            }).desc("Specifies additional globals that the hoist optimization may bind to locals.")
+              .extra(Cell() << nl << fg_cyan << "LIST" << reset << " is a comma-separated list of global names.  "
+                               "Only list globals whose values are set before a template runs and don't change while it "
+                               "runs, since hoisted locals are initialized when the template starts."))
+
+         (param ({ },{ "emit-strategy" }, "STRATEGY", [&](const S& str) {
+               if (str == "direct") {
+                  options_.codegen.strategy = CodegenOptions::Strategy::direct;
+               } else if (str == "buffer") {
+                  options_.codegen.strategy = CodegenOptions::Strategy::buffer;
+               } else {
+                  throw std::runtime_error("Unrecognized emit strategy: " + str);
+               }
+            }).desc("Specifies how generated code writes its output.")
+              .extra(Cell() << nl << fg_cyan << "direct" << reset << " (the default) calls the writer function for each piece of output.  "
+                            << fg_cyan << "buffer" << reset << " rewrites writer calls to store strings and numbers in a local "
+                               "table, which is written with a single " << fg_cyan << "table.concat" << reset << " when the template "
+                               "ends and before any other function call statement, so output from other templates stays in order.  "
+                               "Functions called within expressions must not write output, and buffered output is lost if the "
+                               "template raises an error.  Templates that define functions, or use the writer other than in "
+                               "call statements, are left unchanged.  Applies to all inputs, including those that were "
+                               "specified earlier on the command line."))
+
+         (param ({ },{ "define" }, "KEY=VALUE", [&](const S& str) {
+               std::pair<S, S> define = parse_define(str);
+               auto& defines = options_.codegen.defines;
+               defines.erase(std::remove_if(defines.begin(), defines.end(),
+                  [&](const std::pair<S, S>& d) { return d.first == define.first; }), defines.end());
+               defines.push_back(std::move(define));
+            }).desc("Replaces reads of a global variable with a constant value.")
+              .extra(Cell() << nl << fg_cyan << "VALUE" << reset << " may be "
+                            << fg_cyan << "true" << reset << ", " << fg_cyan << "false" << reset << ", "
+                            << fg_cyan << "nil" << reset << ", or a number; anything else is treated as a string.  "
+                               "If " << fg_cyan << "=VALUE" << reset << " is omitted, " << fg_cyan << "true" << reset
+                            << " is used.  Globals that a template declares or assigns are left unchanged.  After "
+                               "replacement, if/elseif conditions that are constant (using only literals, parentheses, "
+                            << fg_cyan << "not" << reset << ", " << fg_cyan << "and" << reset << ", "
+                            << fg_cyan << "or" << reset << ", and comparisons) are evaluated, and branches that "
+                               "can never run are removed.  May be specified multiple times; a later definition of the "
+                               "same name replaces an earlier one.  Applies to all inputs, including those that were "
+                               "specified earlier on the command line."))
+
+         (param ({ },{ "variant" }, "NAME:DEFINES", [&](const S& str) {
+               std::size_t colon = std::min(str.find(':'), str.size());
+               S name = str.substr(0, colon);
+               if (name.empty() || name.find_first_of("/\\{}") != S::npos) {
+                  throw std::runtime_error("Invalid variant name: " + name);
+               }
+
+               std::vector<std::pair<S, S>> defines;
+               std::size_t begin = colon + 1;
+               while (begin < str.size()) {
+                  std::size_t end = std::min(str.find(',', begin), str.size());
+                  if (end > begin) {
+                     defines.push_back(parse_define(str.substr(begin, end - begin)));
+                  }
+                  begin = end + 1;
+               }
+               variant_specs.emplace_back(std::move(name), std::move(defines));
+            }).desc("Adds a variant to generate for each input.")
+              .extra(Cell() << nl << fg_cyan << "DEFINES" << reset << " is a comma-separated list of "
+                            << fg_cyan << "KEY=VALUE" << reset << " pairs, with the same meaning as "
+                            << fg_yellow << "--define" << reset << "; they are added to (or replace) any global "
+                               "definitions for this variant only.  When any variants are specified, each input is "
+                               "compiled by the BLT compiler once, and a separate Lua (and/or bytecode) output is written "
+                               "for each variant, named according to " << fg_yellow << "--variant-output" << reset
+                            << ".  Parse trees are still written once per input.  Can't be combined with "
+                            << fg_yellow << "--bundle" << reset << "."))
+
+         (param ({ },{ "variant-output" }, "PATTERN", [&](const S& str) {
+               options_.variant_pattern = str;
+            }).desc("Specifies how the output paths for each variant are named.")
+              .extra(Cell() << nl << fg_cyan << "{name}" << reset << " is replaced with the name of the output "
+                               "file that would be used without variants, without its extension, "
+                            << fg_cyan << "{ext}" << reset << " with that extension, and "
+                            << fg_cyan << "{variant}" << reset << " with the variant name.  Relative patterns are "
+                               "resolved against the directory of that output file.  Defaults to "
+                            << fg_cyan << "{name}.{variant}.{ext}" << reset << "."))
+
+         (param ({ },{ "inline" }, "FUNCTION", [&](const S& str) {
+               options_.codegen.include_function = str;
+            }).desc("Inlines small templates included by calling the specified function.")
+              .extra(Cell() << nl << "Statements of the form " << fg_cyan << "FUNCTION(\"name\")" << reset
+                            << " are replaced by the compiled code of the named template, if it can be found in the "
+                               "search paths (as given, or with '.blt' appended) and is no larger than "
+                            << fg_yellow << "--inline-max-size" << reset << ".  Included templates are inlined "
+                               "recursively.  Templates that use " << fg_cyan << "return" << reset << ", "
+                            << fg_cyan << "goto" << reset << ", or " << fg_cyan << "..." << reset << ", or that use "
+                               "names which are locals in the including template, are still included at runtime.  "
+                               "Inlined code is placed on the line of the call, so Lua errors it raises report that line.  "
+                               "Only use this if " << fg_cyan << "FUNCTION" << reset << " runs templates in the caller's "
+                               "environment.  Applies to all inputs, including those that were specified earlier on the "
+                               "command line."))
+
+         (param ({ },{ "inline-max-size" }, "BYTES", [&](const S& str) {
+               options_.codegen.inline_max_size = (std::size_t)std::stoul(str);
+            }).desc("Specifies the largest template source file that will be inlined.")
+              .extra(Cell() << nl << "Defaults to " << fg_cyan << default_inline_max_size << reset << ".  See "
+                            << fg_yellow << "--inline" << reset << "."))
+
+         (param ({ },{ "depfile" }, "PATH", [&](const S& str) {
+               options_.depfile_dest = str;
+            }).desc("Writes a Makefile-style dependency file listing the inputs of each output.")
+              .extra(Cell() << nl << "Each output file written depends on its input file and on any templates that were "
+                               "inlined into it (see " << fg_yellow << "--inline" << reset << ").  Relative paths are "
+                               "resolved the same way as for " << fg_yellow << "--output" << reset << "."))
+
+         (param ({ },{ "target" }, "VM", [&](const S& str) {
+               if (str == "lua") {
+                  options_.codegen.target = CodegenOptions::Target::lua;
+               } else if (str == "luajit") {
+                  options_.codegen.target = CodegenOptions::Target::luajit;
+                  options_.codegen.coalesce_writes = true;
+                  options_.codegen.strategy = CodegenOptions::Strategy::buffer;
+               } else {
+                  throw std::runtime_error("Unrecognized target: " + str);
+               }
+            }).desc("Specifies which Lua implementation the generated code will run on.")
+              .extra(Cell() << nl << fg_cyan << "lua" << reset << " (the default) targets PUC-Lua 5.1 through 5.4.  "
+                            << fg_cyan << "luajit" << reset << " enables the " << fg_cyan << "coalesce" << reset
+                            << " optimization and the " << fg_cyan << "buffer" << reset << " emit strategy, so that loops in "
+                               "templates append to a buffer instead of calling the writer on every iteration (writers are "
+                               "often C functions that the JIT compiler can't trace through).  Later " << fg_yellow << "--optimize" << reset << " and "
+                            << fg_yellow << "--emit-strategy" << reset << " options override these defaults.  The rendered "
+                               "output is the same for either target.  Applies to all inputs, including those that were "
+                               "specified earlier on the command line."))
+
+         (flag ({ },{ "string-buffer" }, options_.codegen.string_buffer)
+            .desc("Collects output in a LuaJIT string.buffer when it is available.")
+            .extra(Cell() << nl << "Requires " << fg_yellow << "--target luajit" << reset << ", and is only used with the "
+                          << fg_cyan << "buffer" << reset << " emit strategy.  The generated code looks for the module in "
+                          << fg_cyan << "package.loaded" << reset << ", and only calls " << fg_cyan << "require" << reset
+                          << " the first time a template runs; if that fails (e.g. LuaJIT 2.0), it records the failure and "
+                             "falls back to a table."))
+
+         (param ({ },{ "writer" }, "NAME", [&](const S& str) {
+               options_.codegen.writer = str;
+            }).desc("Specifies the name of the function that generated code uses to write output.")
+              .extra(Cell() << nl << "Used by optimization passes and emit strategies to recognize writes.  Defaults to "
+                            << fg_cyan << "write" << reset << "."))
+
+         (flag ({ },{ "check" }, options_.check)
+            .desc("Checks inputs for lexer and parser errors without writing any output.")
+            .extra(Cell() << nl << "Output paths are not resolved and no files are created or modified.  "
+                                   "Any errors are reported with exit code 6.  Applies to all inputs, including those "
+                                   "that were specified earlier on the command line."))
+
+         (flag ({ },{ "run" }, options_.run)
+            .desc("Renders templates instead of writing the compiled Lua code.")
+            .extra(Cell() << nl << "Each input is compiled in memory and run in an embedded Lua interpreter.  Output "
+                                   "written by the template (through the function named by "
+                            << fg_yellow << "--writer" << reset << ") is saved to the output path, which defaults to "
+                               "the input path without its extension (or with '.out' appended, if it has none).  Each "
+                               "input gets a new interpreter with the standard libraries, the globals from "
+                            << fg_yellow << "--data" << reset << ", and those given with " << fg_yellow << "--set"
+                            << reset << ".  Lua errors raised while rendering are reported with exit code 7.  "
+                               "Ignores " << fg_yellow << "--emit" << reset << ", and can't be combined with "
+                            << fg_yellow << "--bundle" << reset << " or " << fg_yellow << "--variant" << reset << ".  "
+                               "Applies to all inputs, including those that were specified earlier on the command line."))
+
+         (param ({ },{ "bench" }, "N", [&](const S& str) {
+               options_.bench_renders = (std::size_t)std::stoul(str);
+               if (options_.bench_renders == 0) {
+                  throw std::runtime_error("--bench requires at least one render");
+               }
+            }).desc("Measures how quickly compiled templates render.")
+              .extra(Cell() << nl << "Each input is compiled and rendered " << fg_cyan << "N" << reset << " times in "
+                               "an embedded Lua interpreter, set up the same way as for " << fg_yellow << "--run"
+                            << reset << ", and the results are written to standard output instead of any files.  "
+                               "Renders per second, allocated bytes and allocations per render, and the share of time "
+                               "spent collecting garbage are reported for the plain output of the BLT compiler "
+                               "(" << fg_cyan << "baseline" << reset << ") and for the output with the specified "
+                               "optimizations and emit strategy (" << fg_cyan << "configured" << reset << "), or for each "
+                            << fg_yellow << "--variant" << reset << " if any are specified.  Templates that depend on "
+                            << fg_yellow << "--define" << reset << " should be given the same values with "
+                            << fg_yellow << "--set" << reset << ", since the baseline doesn't apply them.  Inputs are "
+                               "always benchmarked one at a time.  Can't be combined with " << fg_yellow << "--run"
+                            << reset << " or " << fg_yellow << "--bundle" << reset << "."))
+
+         (param ({ },{ "data" }, "PATH", [&](const S& str) {
+               options_.data_path = util::parse_path(str);
+            }).desc("Specifies a Lua file that provides data for rendered templates.")
+              .extra(Cell() << nl << "The file is run before each template is rendered (see " << fg_yellow << "--run"
+                            << reset << " and " << fg_yellow << "--bench" << reset << ") and must return a table; each field with a string key is set as a global "
+                               "variable.  It can also define helper functions for templates to call."))
+
+         (param ({ },{ "set" }, "KEY=VALUE", [&](const S& str) {
+               options_.render.globals.push_back(parse_define(str));
+            }).desc("Sets a global variable for rendered templates.")
+              .extra(Cell() << nl << fg_cyan << "VALUE" << reset << " is interpreted the same way as for "
+                            << fg_yellow << "--define" << reset << ".  Variables are set after those from "
+                            << fg_yellow << "--data" << reset << ", in the order specified.  See "
+                            << fg_yellow << "--run" << reset << "."))
+
+         (param ({ "I" },{ "input" }, "STRING", [&](const S& str) {
+               if (dest.empty()) {
+                  dest_type = DestType::console;
+               }
+               jobs_.push_back({ str, dest, SourceType::raw, dest_type, {{ S(), bytecode_dest, cpp_dest, tree_dest }} });
+               dest.clear();
+               dest_type = DestType::path;
+               bytecode_dest.clear();
+               cpp_dest.clear();
+               tree_dest.clear();
+            }).desc(Cell() << "Treats " << fg_cyan << "STRING" << reset << " as a raw BLT template instead of a filename.")
+              .extra(Cell() << nl << "If no output file is specified, it will be directed to standard output."))
+
+         (flag ({ },{ "stdin" }, [&]() {
+               if (dest.empty()) {
+                  dest_type = DestType::console;
+               }
+               jobs_.push_back({ S(), dest, SourceType::console, dest_type, {{ S(), bytecode_dest, cpp_dest, tree_dest }} });
+               dest.clear();
+               dest_type = DestType::path;
+               bytecode_dest.clear();
+               cpp_dest.clear();
+               tree_dest.clear();
+            }).desc("Reads data from standard input and treats it as an input.")
+              .extra(Cell() << nl << "If no output file is specified, it will be directed to standard output.  "
+                                     "Input ends when the first EOF character is encountered.  If multiple "
+                            << fg_yellow << "--stdin" << reset << " flags are provided, the same input will be used for each."))
+
+         (flag ({ },{ "stdin-frames" }, [&]() {
+               jobs_.push_back({ S(), dest, SourceType::frames, dest_type, {{ S(), bytecode_dest, cpp_dest, tree_dest }} });
+               dest.clear();
+               dest_type = DestType::path;
+               bytecode_dest.clear();
+               cpp_dest.clear();
+               tree_dest.clear();
+            }).desc("Reads a stream of templates from standard input, and compiles each one as soon as it arrives.")
+              .extra(Cell() << nl << "Input is a sequence of frames, each starting with a 4-byte little-endian length.  "
+                                     "A frame holds a destination path, a NUL byte, and then the template.  If the "
+                                     "destination is empty, the compiled output is sent back in the response; otherwise it "
+                                     "is saved there, with relative paths resolved the same way as for "
+                            << fg_yellow << "--output" << reset << ".  One response frame is written to standard output "
+                               "for each template, containing its exit code and the size of the output as 4-byte "
+                               "little-endian integers, followed by the output and then any error messages.  Other "
+                               "artifacts (see " << fg_yellow << "--emit" << reset << ") are saved next to the "
+                               "destination, or included in the output if it is empty.  Processing continues until "
+                               "standard input is closed.  Anything else written to standard output meanwhile, such as "
+                               "log messages, is sent to standard error instead.  Can't be combined with "
+                            << fg_yellow << "--stdin" << reset << ", or with " << fg_yellow << "--stdout" << reset
+                            << " or " << fg_yellow << "--output" << reset << ", since each frame has its own "
+                               "destination."))
+
+         (any ([&](const S& str) {
+               jobs_.push_back({ str, dest, SourceType::path, dest_type, {{ S(), bytecode_dest, cpp_dest, tree_dest }} });
+               dest.clear();
+               dest_type = DestType::path;
+               bytecode_dest.clear();
+               cpp_dest.clear();
+               tree_dest.clear();
+               return true;
+            }))
+
+         (flag ({ },{ "persistent-worker" }, persistent_worker_)
+            .desc("Compiles batches of inputs described by requests read from standard input.")
+            .extra(Cell() << nl << "Requests and responses are framed with a 4-byte little-endian length.  Each request "
+                                   "contains the command line arguments for one bltc run, each followed by a NUL byte; "
+                                   "inputs and outputs are specified the same way as on the command line.  Each response "
+                                   "contains the run's exit code (from the table below) and the size of its output as 4-byte little-endian "
+                                   "integers, followed by the output it would have written to standard output and then "
+                                   "its error messages.  Log messages are sent to standard error.  Requests are handled "
+                                   "one at a time until standard input is closed, and the process's compiler state is "
+                                   "reused between them.  " << fg_yellow << "--stdin" << reset << " can't be used in "
+                                   "requests.  All other arguments are ignored."))
+
+         (param ({ "D" },{ "input-dir" }, "PATH", [&](const S& str) {
+               util::parse_multi_path(str, options_.search_paths);
+            }).desc("Specifies a search path in which to search for input files.")
+              .extra(Cell() << nl << "Multiple input directories may be specified by separating them with ';' or ':', or by using multiple "
+                            << fg_yellow << "--input-dir" << reset
+                            << " options.  Directories will be searched in the order they are specified.  If no input directories "
+                               "are specified, the working directory is implicitly searched.  The search path applies to all "
+                               "input files, including ones specified earlier on the command line."))
+
+         (param ({ "d" },{ "output-dir" }, "PATH", [&](const S& str) {
+               if (!options_.output_path.empty()) {
+                  throw std::runtime_error("An output directory has already been specified");
+               }
+               options_.output_path = util::parse_path(str);
+            }).desc("Specifies a directory to resolve relative output paths.")
+              .extra(Cell() << nl << "If no output directory or filename is specified files will be saved in the same directory as "
+                                     "the input file.  If an output filename is specified but not an output directory, the working "
+                                     "directory will be used.  Only one output directory may be specified, and it applies to all "
+                                     "inputs, including those specified earlier on the command line."))
+
+         (end_of_options ())
+
+         (verbosity_param ({ "v" },{ "verbosity" }, "LEVEL", default_log().verbosity_mask()))
+
+         (flag ({ "V" },{ "version" }, show_version).desc("Prints version information to standard output."))
+
+         (param ({ "?" },{ "help" }, "OPTION", [&](const S& value) {
+               show_help = true;
+               help_query = value;
+            }).default_value(S())
+              .allow_options_as_values(true)
+              .desc(Cell() << "Outputs this help message.  For more verbose help, use " << fg_yellow << "--help")
+              .extra(Cell() << nl << "If " << fg_cyan << "OPTION" << reset
+                            << " is provided, the options list will be filtered to show only options that contain that string."))
+
+         (flag ({ },{ "help" }, verbose).ignore_values(true))
+
+         (exit_code (0, "There were no errors."))
+         (exit_code (1, "An unknown error occurred."))
+         (exit_code (2, "There was a problem parsing the command line arguments."))
+         (exit_code (3, "An input file does not exist or is a directory."))
+         (exit_code (4, "An I/O error occurred while reading an input file."))
+         (exit_code (5, "An I/O error occurred while writing an output file."))
+         (exit_code (6, "A BLT lexer or parser error occurred."))
+         (exit_code (7, "A Lua error occurred while rendering a template or loading its data."))
+
+         (example (Cell() << fg_gray << "foo.blt",
+            "Compiles a file named 'foo.blt' in the working directory and saves the output to 'foo.lua'."))
+         (example (Cell() << fg_yellow << "-d " << fg_cyan << "out/" << fg_gray << " bar.blt",
+            "Compiles a file named 'bar.blt' in the working directory and saves the output to 'out/bar.lua'."))
+         (example (Cell() << fg_yellow << "--check " << fg_gray << "*.blt",
+            "Checks every BLT file in the working directory for syntax errors without writing any files."))
+          (example (Cell() << fg_yellow << "--output " << fg_cyan << "asdf" << fg_yellow << " --stdin -o "
+                           << fg_cyan << "bar_out" << fg_gray << " bar.blt",
+            "Compiles a template read from stdin and saves the output to a file called 'asdf' in the working directory, "
+            "then compiles a file named 'bar.blt' in the working directory and saves the output to 'bar_out'."))
+
+         ;
+
+      proc.process(argc, argv);
+
+      for (auto& spec : variant_specs) {
+         Variant variant { spec.first, options_.codegen };
+         for (auto& define : spec.second) {
+            auto& defines = variant.codegen.defines;
+            defines.erase(std::remove_if(defines.begin(), defines.end(),
+               [&](const std::pair<S, S>& d) { return d.first == define.first; }), defines.end());
+            defines.push_back(std::move(define));
+         }
+         options_.variants.push_back(std::move(variant));
+      }
+
+      if (!show_help && !show_version && jobs_.empty() && !persistent_worker_) {
+         show_help = true;
+         show_version = true;
+         status_ = 1;
+      }
+
+      if (show_version) {
+         proc
+            (prologue (BE_BLTC_VERSION_STRING).query())
+            (prologue (BE_BLT_VERSION_STRING).query())
+            (license (BE_LICENSE).query())
+            (license (BE_COPYRIGHT).query())
+            ;
+      }
+
+      std::ostream& out = console_ ? *console_ : std::cout;
+      if (show_help) {
+         proc.describe(out, verbose, help_query);
+      } else if (show_version) {
+         proc.describe(out, verbose, ids::cli_describe_section_prologue);
+         proc.describe(out, verbose, ids::cli_describe_section_license);
+      } else if (!persistent_worker_) {
+         driver_ = std::make_unique<Driver>(std::move(options_), std::move(jobs_));
+      }
+
+   } catch (...) {
+      status_ = 2;
+      fail_(std::current_exception());
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Handles persistent worker requests until stdin is closed.  Each request
+/// is parsed and run by this BltcApp after resetting its per-request state,
+/// so the core library, Compiler::for_thread() (and its buffers and Lua
+/// state), and the worker's log verbosity stay in place between them.  A
+/// request's console output and errors are collected for its response
+/// through console_ and on_error_, and stdout is reserved for responses, so
+/// log messages can't corrupt them.
+int BltcApp::run_worker_() {
+   set_binary_stdio();
+   FrameOutput frames;
+   be_short_verbose() << "Waiting for requests" | default_log();
+
+   S request;
+   S output;
+   S log;
+   S response;
+   auto on_error = [&log](const S& source, I8, const S& message) {
+      if (!source.empty()) {
+         log.append(source).append(": ");
+      }
+      log.append(message).append("\n");
+   };
+
+   try {
+      while (read_frame(std::cin, request)) {
+         std::vector<S> args { "bltc" };
+         std::size_t begin = 0;
+         while (begin < request.size()) {
+            std::size_t end = std::min(request.find('\0', begin), request.size());
+            args.push_back(request.substr(begin, end - begin));
+            begin = end + 1;
+         }
+
+         output.clear();
+         log.clear();
+         I8 result = 0;
+         {
+            StringBuffer buf(output);
+            std::ostream console(&buf);
+            auto it = std::find_if(args.begin() + 1, args.end(), [](const S& arg) {
+                  return arg == "--stdin" || arg == "--stdin-frames" || arg == "--persistent-worker";
+               });
+            if (it != args.end()) {
+               result = 2;
+               on_error(S(), result, *it + " can't be used in persistent worker requests");
+            } else {
+               std::vector<char*> argv;
+               for (S& arg : args) {
+                  argv.push_back(&arg[0]);
+               }
+               argv.push_back(nullptr);
+
+               auto verbosity = default_log().verbosity_mask();
+               reset_(&console, on_error);
+               try {
+                  parse_((int)args.size(), argv.data());
+                  result = (I8)(*this)();
+               } catch (const std::exception& e) {
+                  result = 1;
+                  on_error(S(), result, e.what());
+               }
+               reset_(nullptr, ErrorHandler());
+               default_log().verbosity_mask(verbosity);
+            }
+         }
+
+         response.clear();
+         append_u32(response, (U32)result);
+         append_u32(response, (U32)output.size());
+         response.append(output);
+         response.append(log);
+         write_frame(frames.stream(), response);
+      }
+   } catch (const std::exception& e) {
+      status_ = 4;
+      log_exception(e);
+   }
+
+   return status_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Discards the options, jobs, driver, and status of the previous request.
+void BltcApp::reset_(std::ostream* console, ErrorHandler on_error) {
+   driver_.reset();
+   options_ = Driver::Options();
+   jobs_.clear();
+   persistent_worker_ = false;
+   status_ = 0;
+   console_ = console;
+   on_error_ = std::move(on_error);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Reports an error from parsing the command line to the error handler, or
+/// logs it.
+void BltcApp::fail_(const std::exception_ptr& error) {
+   if (on_error_) {
+      try {
+         std::rethrow_exception(error);
+      } catch (const std::exception& e) {
+         on_error_(S(), status_, e.what());
+      } catch (...) {
+         on_error_(S(), status_, "Unknown error");
+      }
+      return;
+   }
+
+   try {
+      std::rethrow_exception(error);
+   } catch (const cli::OptionError& e) {
+      cli::log_exception(e);
+   } catch (const cli::ArgumentError& e) {
+      cli::log_exception(e);
+   } catch (const FatalTrace& e) {
+      log_exception(e);
+   } catch (const RecoverableTrace& e) {
+      log_exception(e);
+   } catch (const fs::filesystem_error& e) {
+      log_exception(e);
+   } catch (const std::system_error& e) {
+      log_exception(e);
+   } catch (const std::exception& e) {
+      log_exception(e);
+   } catch (...) {
+      be_error() << "Unknown error" | default_log();
+   }
+}
+
+} // be::bltc
+} // be
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef BE_BLTC_BLTC_APP_HPP_
+#define BE_BLTC_BLTC_APP_HPP_
+
+#include "driver.hpp"
+#include <be/core/lifecycle.hpp>
+#include <functional>
+#include <memory>
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+class BltcApp final {
+public:
+   BltcApp(int argc, char** argv);
+
+   int operator()();
+
+private:
+   using Artifact = Driver::Artifact;
+   using SourceType = Driver::SourceType;
+   using DestType = Driver::DestType;
+   using Job = Driver::Job;
+   using Variant = Driver::Variant;
+   using ErrorHandler = std::function<void(const S& source, I8 status, const S& message)>;
+
+   void parse_(int argc, char** argv);
+   int run_worker_();
+   void reset_(std::ostream* console, ErrorHandler on_error);
+   void fail_(const std::exception_ptr& error);
+
+   CoreInitLifecycle init_;
+   std::ostream* console_ = nullptr; // receives help and console output if set
+   ErrorHandler on_error_; // receives errors instead of the log if set
+   Driver::Options options_;
+   std::vector<Job> jobs_;
+   bool persistent_worker_ = false;
+   I8 status_ = 0;
+   std::unique_ptr<Driver> driver_;
+};
+
+} // be::bltc
+} // be
+
+#endif
@@ -0,0 +1,68 @@
+#include "api.hpp"
+#include <fstream>
+
+namespace be {
+namespace bltc {
+
+///////////////////////////////////////////////////////////////////////////////
+S compile_buffer(const S& source, const CodegenOptions& options) {
+   Compiler& compiler = Compiler::for_thread();
+   S lua = compiler.compile(source, options);
+   compiler.reset();
+   return lua;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void compile_file(const Path& input, const Path& output, const CodegenOptions& options) {
+   Compiler& compiler = Compiler::for_thread();
+   I8 status = 4;
+   try {
+      const S& source = compiler.load(input);
+      status = 6;
+      const S& lua = compiler.compile(source, options);
+
+      status = 5;
+      if (output.has_parent_path() && !fs::exists(output.parent_path())) {
+         fs::create_directories(output.parent_path());
+      }
+
+      std::ofstream ofs(output.native(), std::ios::binary);
+      if (!ofs) {
+         throw std::ios::failure("Could not open file: " + output.string());
+      }
+
+      ofs.write(lua.data(), (std::streamsize)lua.size());
+      compiler.reset();
+      ofs.close();
+      if (ofs.fail()) {
+         throw std::ios::failure("Error while writing file: " + output.string());
+      }
+   } catch (const std::bad_alloc&) {
+      compiler.reset();
+      throw;
+   } catch (const std::exception& e) {
+      compiler.reset();
+      throw CompileFileError(status, e.what());
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+I8 compile_batch(const std::vector<std::pair<Path, Path>>& files, Driver::Options options) {
+   std::vector<Driver::Job> jobs;
+   jobs.reserve(files.size());
+   for (auto& file : files) {
+      Driver::Job job;
+      // absolute inputs are used as-is, rather than being matched against the search paths
+      job.source = fs::absolute(file.first).string();
+      job.dest = file.second.string();
+      job.source_type = Driver::SourceType::path;
+      job.dest_type = Driver::DestType::path;
+      jobs.push_back(std::move(job));
+   }
+
+   Driver driver(std::move(options), std::move(jobs));
+   return driver();
+}
+
+} // be::bltc
+} // be
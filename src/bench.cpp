@@ -0,0 +1,71 @@
+#include "bench.hpp"
+#include <lua.hpp>
+#include <chrono>
+
+namespace be {
+namespace bltc {
+namespace {
+
+// Garbage is collected whenever this much has been allocated since the last
+// collection, so long benchmarks don't hold every render's garbage at once.
+const std::size_t gc_batch_bytes = 16 * 1024 * 1024;
+
+///////////////////////////////////////////////////////////////////////////////
+double seconds_since(std::chrono::steady_clock::time_point start) {
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Renders the template loaded by renderer repeatedly, measuring the
+///         time spent rendering and collecting garbage separately.
+///
+/// \details stats must be the LuaAllocStats that renderer was created with.
+///         One untimed render is done first.  The collector is then stopped
+///         while rendering, and full collections are run between batches of
+///         renders and after the last one; their total is reported as GC time.
+///         Full collections also traverse live objects, so this somewhat
+///         overstates what the incremental collector would spend.
+BenchResult benchmark(Renderer& renderer, const LuaAllocStats& stats, std::size_t renders) {
+   using clock = std::chrono::steady_clock;
+   lua_State* L = renderer.lua().get();
+   BenchResult result;
+   S out;
+
+   renderer.render(out);
+   result.output_size = out.size();
+   lua_gc(L, LUA_GCCOLLECT, 0);
+   lua_gc(L, LUA_GCSTOP, 0);
+
+   std::size_t allocations = stats.allocations;
+   std::size_t bytes = stats.bytes;
+   try {
+      while (result.renders < renders) {
+         std::size_t collect_at = stats.bytes + gc_batch_bytes;
+         clock::time_point start = clock::now();
+         do {
+            out.clear();
+            renderer.render(out);
+            ++result.renders;
+         } while (result.renders < renders && stats.bytes < collect_at);
+         result.render_seconds += seconds_since(start);
+
+         start = clock::now();
+         lua_gc(L, LUA_GCCOLLECT, 0);
+         result.gc_seconds += seconds_since(start);
+      }
+   } catch (...) {
+      lua_gc(L, LUA_GCRESTART, 0);
+      throw;
+   }
+   lua_gc(L, LUA_GCRESTART, 0);
+
+   // full collections don't allocate, so everything counted was done by renders
+   result.allocations = stats.allocations - allocations;
+   result.bytes = stats.bytes - bytes;
+   return result;
+}
+
+} // be::bltc
+} // be
@@ -0,0 +1,198 @@
+#include "bundle.hpp"
+#include "lua_lexer.hpp"
+#include "lua_passes.hpp"
+#include <stdexcept>
+
+namespace be {
+namespace bltc {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// Lua converts every line break inside a long string to '\n', so the
+/// sources are stored that way to begin with; otherwise offsets recorded in
+/// the index would be wrong at runtime.  This doesn't change the meaning of
+/// the chunk, since the Lua lexer treats all line breaks the same.
+void append_normalized(S& out, const S& lua, std::size_t begin) {
+   out.reserve(out.size() + lua.size() - begin);
+   for (std::size_t i = begin; i < lua.size(); ++i) {
+      char c = lua[i];
+      if (c == '\r' || c == '\n') {
+         if (i + 1 < lua.size() && (lua[i + 1] == '\r' || lua[i + 1] == '\n') && lua[i + 1] != c) {
+            ++i;
+         }
+         out.push_back('\n');
+      } else {
+         out.push_back(c);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+S long_bracket_level(const S& content) {
+   S level;
+   for (;;) {
+      if (content.find("]" + level + "]") == S::npos) {
+         return level;
+      }
+      level.push_back('=');
+   }
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Enables sharing of string literals at least min_length bytes
+///         long, or disables it if min_length is 0.
+void Bundle::intern(std::size_t min_length) {
+   intern_min_length_ = min_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Adds a compiled template to the bundle.
+///
+/// \details Throws std::runtime_error if a template with the same name has
+///         already been added.
+void Bundle::add(const S& name, const S& lua) {
+   if (!names_.emplace(name, entries_.size()).second) {
+      throw std::runtime_error("Bundle already contains a template named " + name);
+   }
+
+   // load() doesn't skip a leading shebang line the way loadfile() does;
+   // the line break is kept so line numbers don't change.
+   std::size_t begin = 0;
+   if (!lua.empty() && lua[0] == '#') {
+      begin = std::min(lua.find_first_of("\r\n"), lua.size());
+   }
+
+   Entry entry;
+   entry.name = name;
+   entry.offset = sources_.size();
+   append_normalized(sources_, lua, begin);
+   entry.length = sources_.size() - entry.offset;
+   entry.interned = false;
+   entries_.push_back(std::move(entry));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::size_t Bundle::size() const {
+   return entries_.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Bundle::write(std::ostream& os) const {
+   std::vector<Entry> interned_entries;
+   S interned_sources;
+   std::vector<S> constants;
+   if (intern_min_length_ > 0) {
+      intern_(interned_entries, interned_sources, constants);
+   }
+
+   const std::vector<Entry>& entries = constants.empty() ? entries_ : interned_entries;
+   const S& sources = constants.empty() ? sources_ : interned_sources;
+
+   S out;
+   out.append("-- Generated by bltc; templates are compiled the first time they are used.\n");
+   if (!constants.empty()) {
+      out.append("local constants = {\n");
+      for (const S& value : constants) {
+         out.append("   ");
+         append_lua_string(out, value);
+         out.append(",\n");
+      }
+      out.append("}\n");
+   }
+
+   out.append("local index = {\n");
+   for (const Entry& entry : entries) {
+      out.append("   [");
+      append_lua_string(out, entry.name);
+      out.append("] = { ").append(std::to_string(entry.offset + 1))
+         .append(", ").append(std::to_string(entry.length));
+      if (entry.interned) {
+         out.append(", true");
+      }
+      out.append(" },\n");
+   }
+
+   S level = long_bracket_level(sources);
+   out.append("}\n"
+              "local sources = [").append(level).append("[\n");
+   os.write(out.data(), (std::streamsize)out.size());
+   os.write(sources.data(), (std::streamsize)sources.size());
+
+   // the extra line break keeps a ']' at the end of the sources from being
+   // read as part of the closing bracket
+   out.clear();
+   out.append("\n]").append(level).append("]\n"
+              "local load = loadstring or load\n"
+              "return setmetatable({}, { __index = function(templates, name)\n"
+              "   local entry = index[name]\n"
+              "   if entry == nil then return nil end\n"
+              "   local fn = assert(load(sources:sub(entry[1], entry[1] + entry[2] - 1), \"=\" .. name))\n");
+   if (!constants.empty()) {
+      out.append("   if entry[3] then fn = fn(constants) end\n");
+   }
+   out.append("   templates[name] = fn\n"
+              "   return fn\n"
+              "end })\n");
+   os.write(out.data(), (std::streamsize)out.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Literals are shared if they're at least intern_min_length_ bytes long and
+/// appear at least twice in the bundle (in one template or several).
+/// Constants are numbered in order of first appearance so the output doesn't
+/// depend on hashing.  Templates that can't be lexed are left unchanged.
+void Bundle::intern_(std::vector<Entry>& entries, S& sources, std::vector<S>& constants) const {
+   std::unordered_map<S, std::size_t> counts;
+   std::vector<S> order;
+   std::vector<S> values;
+   for (const Entry& entry : entries_) {
+      values.clear();
+      try {
+         find_strings(sources_.substr(entry.offset, entry.length), intern_min_length_, values);
+      } catch (const std::runtime_error&) {
+         continue;
+      }
+
+      for (S& value : values) {
+         if (++counts[value] == 1) {
+            order.push_back(std::move(value));
+         }
+      }
+   }
+
+   std::unordered_map<S, std::size_t> indices;
+   for (S& value : order) {
+      if (counts[value] > 1) {
+         constants.push_back(std::move(value));
+         indices.emplace(constants.back(), constants.size());
+      }
+   }
+
+   if (constants.empty()) {
+      return;
+   }
+
+   entries.reserve(entries_.size());
+   sources.reserve(sources_.size());
+   S chunk;
+   S interned;
+   for (const Entry& entry : entries_) {
+      Entry copy = entry;
+      copy.offset = sources.size();
+      chunk.assign(sources_, entry.offset, entry.length);
+      try {
+         copy.interned = intern_strings(chunk, interned, indices, "__bltc_k");
+      } catch (const std::runtime_error&) {
+         copy.interned = false;
+      }
+
+      sources.append(copy.interned ? interned : chunk);
+      copy.length = sources.size() - copy.offset;
+      entries.push_back(std::move(copy));
+   }
+}
+
+} // be::bltc
+} // be
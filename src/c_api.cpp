@@ -0,0 +1,242 @@
+#include "c_api.h"
+#include "api.hpp"
+#include <be/core/lifecycle.hpp>
+#include <be/util/path_glob.hpp>
+#include <cstdlib>
+#include <cstring>
+
+namespace be {
+namespace bltc {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// Fields beyond options->size were added after the caller was compiled, so
+/// they keep their default values.
+template <typename T>
+const T* field(const bltc_options* options, const T bltc_options::* member) {
+   const T* ptr = &(options->*member);
+   std::size_t offset = (std::size_t)((const char*)ptr - (const char*)options);
+   return options->size >= offset + sizeof(T) ? ptr : nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+char* copy_string(const S& str) {
+   char* ptr = (char*)std::malloc(str.size() + 1);
+   if (ptr) {
+      std::memcpy(ptr, str.data(), str.size());
+      ptr[str.size()] = '\0';
+   }
+   return ptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int fail(I8 status, const S& message, char** error) {
+   if (error) {
+      *error = copy_string(message);
+   }
+   return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Copies the fields of a bltc_options that apply to a single template.
+class Settings final {
+public:
+   explicit Settings(const bltc_options* options) {
+      codegen_.inline_max_size = default_inline_max_size;
+      if (!options) {
+         return;
+      }
+
+      auto writer = field(options, &bltc_options::writer);
+      if (writer && *writer) {
+         codegen_.writer = *writer;
+      }
+
+      auto optimize = field(options, &bltc_options::optimize);
+      if (optimize && *optimize) {
+         codegen_.coalesce_writes = true;
+         codegen_.hoist_globals = true;
+      }
+
+      auto buffer_output = field(options, &bltc_options::buffer_output);
+      if (buffer_output && *buffer_output) {
+         codegen_.strategy = CodegenOptions::Strategy::buffer;
+      }
+
+      auto search_paths = field(options, &bltc_options::search_paths);
+      auto search_path_count = field(options, &bltc_options::search_path_count);
+      if (search_paths && *search_paths && search_path_count) {
+         for (std::size_t i = 0; i < *search_path_count; ++i) {
+            search_paths_.push_back(util::parse_path((*search_paths)[i]));
+         }
+      }
+
+      auto include_function = field(options, &bltc_options::include_function);
+      if (include_function && *include_function) {
+         codegen_.include_function = *include_function;
+      }
+   }
+
+   /// Resolves includes against the search paths, as bltc would.  Not
+   /// needed for batches, since Driver sets this up itself.
+   const CodegenOptions& codegen() {
+      if (!codegen_.include_function.empty() && !codegen_.resolve_include) {
+         if (search_paths_.empty()) {
+            search_paths_.push_back(util::cwd());
+         }
+         index_ = std::make_unique<SearchPathIndex>(search_paths_);
+         SearchPathIndex* index = index_.get();
+         codegen_.resolve_include = [index](const S& name, Path& path) {
+            std::vector<Path> paths = index->resolve(name);
+            if (paths.empty()) {
+               paths = index->resolve(name + ".blt");
+            }
+            if (paths.empty()) {
+               return false;
+            }
+            path = paths.front();
+            return true;
+         };
+      }
+      return codegen_;
+   }
+
+   Driver::Options driver_options() const {
+      Driver::Options options;
+      options.codegen = codegen_;
+      options.search_paths = search_paths_;
+      return options;
+   }
+
+private:
+   CodegenOptions codegen_;
+   std::vector<Path> search_paths_;
+   std::unique_ptr<SearchPathIndex> index_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// The core library stays initialized from the first call until the process
+/// exits.
+CoreInitLifecycle& core_init() {
+   static CoreInitLifecycle init;
+   return init;
+}
+
+} // be::bltc::()
+} // be::bltc
+} // be
+
+using namespace be;
+using namespace be::bltc;
+
+///////////////////////////////////////////////////////////////////////////////
+void bltc_options_init(bltc_options* options) {
+   std::memset(options, 0, sizeof(bltc_options));
+   options->size = sizeof(bltc_options);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int bltc_compile_buffer(const char* source, size_t source_size, const bltc_options* options,
+                        char** output, size_t* output_size, char** error) {
+   if (error) {
+      *error = nullptr;
+   }
+   if (output) {
+      *output = nullptr;
+   }
+   if (output_size) {
+      *output_size = 0;
+   }
+
+   try {
+      core_init();
+      Settings settings(options);
+      S lua = compile_buffer(S(source, source_size), settings.codegen());
+      if (output) {
+         *output = copy_string(lua);
+         if (!*output) {
+            return fail(1, "Out of memory", error);
+         }
+      }
+      if (output_size) {
+         *output_size = lua.size();
+      }
+      return 0;
+   } catch (const std::bad_alloc&) {
+      return fail(1, "Out of memory", error);
+   } catch (const std::exception& e) {
+      return fail(6, e.what(), error);
+   } catch (...) {
+      return fail(1, "Unknown error", error);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int bltc_compile_file(const char* input, const char* output, const bltc_options* options, char** error) {
+   if (error) {
+      *error = nullptr;
+   }
+
+   try {
+      core_init();
+      Settings settings(options);
+      compile_file(util::parse_path(input), util::parse_path(output), settings.codegen());
+      return 0;
+   } catch (const std::bad_alloc&) {
+      return fail(1, "Out of memory", error);
+   } catch (const CompileFileError& e) {
+      return fail(e.status(), e.what(), error);
+   } catch (const std::exception& e) {
+      return fail(1, e.what(), error);
+   } catch (...) {
+      return fail(1, "Unknown error", error);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int bltc_compile_batch(const char* const* inputs, const char* const* outputs, size_t count,
+                       const bltc_options* options, char** error) {
+   if (error) {
+      *error = nullptr;
+   }
+
+   try {
+      core_init();
+      Settings settings(options);
+      std::vector<std::pair<Path, Path>> files;
+      files.reserve(count);
+      for (std::size_t i = 0; i < count; ++i) {
+         Path output;
+         if (outputs && outputs[i]) {
+            output = util::parse_path(outputs[i]);
+         }
+         files.emplace_back(util::parse_path(inputs[i]), std::move(output));
+      }
+
+      S messages;
+      Driver::Options driver_options = settings.driver_options();
+      driver_options.on_error = [&](const S& source, I8, const S& message) {
+            messages.append(source);
+            messages.append(": ");
+            messages.append(message);
+            messages.push_back('\n');
+         };
+
+      I8 status = compile_batch(files, std::move(driver_options));
+      if (status != 0) {
+         return fail(status, messages, error);
+      }
+      return 0;
+   } catch (const std::bad_alloc&) {
+      return fail(1, "Out of memory", error);
+   } catch (const std::exception& e) {
+      return fail(1, e.what(), error);
+   } catch (...) {
+      return fail(1, "Unknown error", error);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void bltc_free(void* ptr) {
+   std::free(ptr);
+}
@@ -0,0 +1,341 @@
+#include "compiler.hpp"
+#include "lua_passes.hpp"
+#include "lua_state.hpp"
+#include <be/blt/blt.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace be {
+namespace bltc {
+namespace {
+
+// Buffers larger than this are released by Compiler::reset() (or when they
+// are next reused) instead of being kept around for the next job.
+const std::size_t max_retained_capacity = 64 * 1024 * 1024;
+
+///////////////////////////////////////////////////////////////////////////////
+void reset_buffer(S& buffer) {
+   if (buffer.capacity() > max_retained_capacity) {
+      S().swap(buffer);
+   } else {
+      buffer.clear();
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool has_passes(const CodegenOptions& options) {
+   return (!options.include_function.empty() && options.inline_max_size > 0 && options.resolve_include) ||
+          !options.defines.empty() ||
+          options.coalesce_writes ||
+          options.hoist_globals ||
+          options.strategy == CodegenOptions::Strategy::buffer;
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+StringBuffer::int_type StringBuffer::overflow(int_type c) {
+   if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      str_.push_back(traits_type::to_char_type(c));
+   }
+   return traits_type::not_eof(c);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::streamsize StringBuffer::xsputn(const char* s, std::streamsize n) {
+   str_.append(s, (std::size_t)n);
+   return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+NullBuffer::int_type NullBuffer::overflow(int_type c) {
+   return traits_type::not_eof(c);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::streamsize NullBuffer::xsputn(const char*, std::streamsize n) {
+   return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Compiler::Compiler()
+   : output_buf_(output_),
+     output_os_(&output_buf_),
+     null_os_(&null_buf_) { }
+
+///////////////////////////////////////////////////////////////////////////////
+Compiler::~Compiler() = default;
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Replaces the contents of the input buffer with the contents of a
+///         file.
+const S& Compiler::load(const Path& path) {
+   clear_input();
+
+   std::ifstream ifs(path.native(), std::ios::binary);
+   if (!ifs) {
+      throw std::ios::failure("Could not open file: " + path.string());
+   }
+
+   // pipes and other special files have no size (and can't seek), so the
+   // size is only a hint and the file is always read until EOF
+   std::error_code ec;
+   std::uintmax_t size = fs::file_size(path, ec);
+   if (!ec && size > 0) {
+      input_.reserve((std::size_t)size);
+   }
+
+   char chunk[64 * 1024];
+   do {
+      ifs.read(chunk, sizeof(chunk));
+      input_.append(chunk, (std::size_t)ifs.gcount());
+   } while (ifs);
+
+   if (ifs.bad()) {
+      clear_input();
+      throw std::ios::failure("Error while reading file: " + path.string());
+   }
+
+   return input_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Compiler::clear_input() {
+   reset_buffer(input_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Clears every buffer once a job is done, so that buffers grown
+///         beyond max_retained_capacity aren't held until the next job.
+///
+/// \details Invalidates all references previously returned.
+void Compiler::reset() {
+   reset_buffer(input_);
+   reset_buffer(generated_);
+   reset_buffer(output_);
+   reset_buffer(scratch_);
+   reset_buffer(bytecode_);
+   includes_.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const S& Compiler::input() const {
+   return input_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const S& Compiler::compile(const S& input, const CodegenOptions& options) {
+   reset_buffer(output_);
+   dependencies_.clear();
+   includes_.clear();
+   output_os_.clear();
+   blt::compile_blt(input, output_os_);
+   optimize_(options);
+   return output_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Compiles input and writes the result to os.
+///
+/// \details When options don't enable any post-processing, the BLT compiler
+///         writes straight to os, so the output is never held in memory.
+///         Otherwise this is equivalent to writing the result of compile().
+void Compiler::compile(const S& input, const CodegenOptions& options, std::ostream& os) {
+   if (has_passes(options)) {
+      const S& output = compile(input, options);
+      os.write(output.data(), (std::streamsize)output.size());
+      return;
+   }
+
+   reset_buffer(output_);
+   dependencies_.clear();
+   includes_.clear();
+   blt::compile_blt(input, os);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Runs the BLT compiler without any post-processing, and keeps the
+///         result so that it can be passed to optimize() several times.
+const S& Compiler::generate(const S& input) {
+   reset_buffer(output_);
+   dependencies_.clear();
+   includes_.clear();
+   output_os_.clear();
+   blt::compile_blt(input, output_os_);
+   generated_.swap(output_);
+   reset_buffer(output_);
+   return generated_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Post-processes Lua code from generate() according to options.
+///
+/// \details Equivalent to compile() on the original input, without running
+///         the BLT compiler again.
+const S& Compiler::optimize(const S& generated, const CodegenOptions& options) {
+   output_.assign(generated);
+   optimize_(options);
+   return output_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Compiler::optimize_(const CodegenOptions& options) {
+   if (!options.include_function.empty() && options.inline_max_size > 0 && options.resolve_include) {
+      std::vector<Path> stack;
+      inline_includes_(output_, scratch_, options, stack, dependencies_);
+      output_.swap(scratch_);
+   }
+
+   if (!options.defines.empty()) {
+      apply_defines(output_, scratch_, options.defines);
+      output_.swap(scratch_);
+   }
+
+   if (options.coalesce_writes) {
+      coalesce_writes(output_, scratch_, options.writer);
+      output_.swap(scratch_);
+   }
+
+   if (options.hoist_globals) {
+      hoist_globals(output_, scratch_, options.writer, options.hoist_names);
+      output_.swap(scratch_);
+   }
+
+   if (options.strategy == CodegenOptions::Strategy::buffer && buffer_writes(output_, scratch_, options.writer,
+                     options.target == CodegenOptions::Target::luajit && options.string_buffer)) {
+      output_.swap(scratch_);
+   }
+
+   reset_buffer(scratch_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Inlines the templates included by source, and adds the paths of those
+/// that were inlined (directly or indirectly) to dependencies.
+void Compiler::inline_includes_(const S& source, S& out, const CodegenOptions& options, std::vector<Path>& stack,
+                                std::vector<Path>& dependencies) {
+   std::unordered_map<S, std::pair<Path, const Include*>> loaded;
+   std::vector<S> inlined;
+   inline_includes(source, out, options.include_function, [&](const S& name, S& lua) {
+         Path path;
+         if (!options.resolve_include(name, path)) {
+            return false;
+         }
+
+         const Include* include = load_include_(path, options, stack);
+         if (!include) {
+            return false;
+         }
+
+         loaded[name] = std::make_pair(path, include);
+         lua = include->lua;
+         return true;
+      }, inlined);
+
+   auto add = [&](const Path& path) {
+      if (std::find(dependencies.begin(), dependencies.end(), path) == dependencies.end()) {
+         dependencies.push_back(path);
+      }
+   };
+
+   for (const S& name : inlined) {
+      const auto& entry = loaded[name];
+      add(entry.first);
+      for (const Path& path : entry.second->dependencies) {
+         add(path);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Compiles an included template, inlining its own includes.  Returns null
+/// for templates that can't be read or compiled, are too large, or include
+/// themselves (directly or indirectly), so they're left to be included at
+/// runtime.  Results are cached until the next call to compile() or
+/// generate(), so each variant doesn't have to load them again.
+const Compiler::Include* Compiler::load_include_(const Path& path, const CodegenOptions& options, std::vector<Path>& stack) {
+   if (std::find(stack.begin(), stack.end(), path) != stack.end()) {
+      return nullptr;
+   }
+
+   S key = path.generic_string();
+   auto it = includes_.find(key);
+   if (it != includes_.end()) {
+      return &it->second;
+   }
+
+   S generated;
+   try {
+      if (fs::file_size(path) > options.inline_max_size) {
+         return nullptr;
+      }
+
+      std::ifstream ifs(path.native(), std::ios::binary);
+      std::ostringstream oss;
+      oss << ifs.rdbuf();
+      if (!ifs) {
+         return nullptr;
+      }
+
+      StringBuffer buf(generated);
+      std::ostream os(&buf);
+      blt::compile_blt(oss.str(), os);
+   } catch (const std::exception&) {
+      return nullptr;
+   }
+
+   Include include;
+   stack.push_back(path);
+   inline_includes_(generated, include.lua, options, stack, include.dependencies);
+   stack.pop_back();
+
+   return &(includes_[key] = std::move(include));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Returns the included templates that were inlined by the last call
+///         to compile() (or generate() and optimize()).
+const std::vector<Path>& Compiler::dependencies() const {
+   return dependencies_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const S& Compiler::debug(const S& input) {
+   reset_buffer(output_);
+   output_os_.clear();
+   blt::debug_blt(input, output_os_);
+   return output_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Compiler::check(const S& input) {
+   null_os_.clear();
+   blt::compile_blt(input, null_os_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Converts Lua source code (usually the result of compile()) to
+///         bytecode for the Lua version bltc was built with.
+///
+/// \details The Lua state is created the first time it's needed and reused
+///         for later calls.  Throws LuaError if the source isn't valid Lua.
+const S& Compiler::dump(const S& lua, const S& chunk_name, bool strip) {
+   if (!lua_) {
+      lua_ = std::make_unique<LuaState>();
+   }
+
+   reset_buffer(bytecode_);
+   lua_->load(lua, chunk_name);
+   lua_->dump(bytecode_, strip);
+   return bytecode_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Compiler& Compiler::for_thread() {
+   thread_local Compiler compiler;
+   return compiler;
+}
+
+} // be::bltc
+} // be
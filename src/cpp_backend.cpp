@@ -0,0 +1,579 @@
+#include "cpp_backend.hpp"
+#include "lua_lexer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <initializer_list>
+#include <stdexcept>
+
+namespace be {
+namespace bltc {
+namespace {
+
+// Lua names that can't be used as C++ member names
+const char* const cpp_keywords[] = {
+   "alignas", "alignof", "asm", "auto", "bool", "case", "catch", "char", "char16_t", "char32_t", "class",
+   "const", "const_cast", "constexpr", "continue", "decltype", "default", "delete", "double",
+   "dynamic_cast", "enum", "explicit", "export", "extern", "float", "friend", "inline", "int", "long",
+   "mutable", "namespace", "new", "noexcept", "nullptr", "operator", "private", "protected", "public",
+   "register", "reinterpret_cast", "short", "signed", "sizeof", "static", "static_assert", "static_cast",
+   "struct", "switch", "template", "this", "thread_local", "throw", "try", "typedef", "typeid", "typename",
+   "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t"
+};
+
+// Literal text is split into several writes so no single string literal
+// exceeds what every compiler accepts.
+const std::size_t max_literal_size = 4096;
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_cpp_keyword(const S& name) {
+   return std::find_if(std::begin(cpp_keywords), std::end(cpp_keywords),
+      [&](const char* keyword) { return name == keyword; }) != std::end(cpp_keywords);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// True if expr is a (possibly negated) float literal, e.g. 1.5 or 1e3.
+bool is_float_literal(const S& expr) {
+   std::size_t begin = expr.find_first_not_of("(-+ ");
+   std::size_t end = expr.find_last_not_of(") ");
+   if (begin == S::npos || end < begin || !(std::isdigit((unsigned char)expr[begin]) || expr[begin] == '.')) {
+      return false;
+   }
+   S literal = expr.substr(begin, end - begin + 1);
+   if (literal.find_first_not_of("0123456789abcdefABCDEFxXpP.+-") != S::npos) {
+      return false;
+   }
+   return literal.find('.') != S::npos ||
+      (literal.find_first_of("xX") == S::npos && literal.find_first_of("eE") != S::npos);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Appends value as one or more adjacent C++ string literals, starting a new
+/// line (indented by indent) after each newline in the text.
+void append_cpp_string(S& out, const S& value, const S& indent) {
+   static const char digits[] = "01234567";
+   out.push_back('"');
+   for (std::size_t i = 0; i < value.size(); ++i) {
+      unsigned char c = (unsigned char)value[i];
+      switch (c) {
+         case '\\': out.append("\\\\"); break;
+         case '"':  out.append("\\\""); break;
+         case '\t': out.append("\\t"); break;
+         case '\r': out.append("\\r"); break;
+         case '\n':
+            out.append("\\n");
+            if (i + 1 < value.size()) {
+               out.append("\"\n");
+               out.append(indent);
+               out.push_back('"');
+            }
+            break;
+         default:
+            if (c < 0x20 || c == 0x7F) {
+               // always 3 digits, so a following digit isn't absorbed into the escape
+               out.push_back('\\');
+               out.push_back(digits[c >> 6]);
+               out.push_back(digits[(c >> 3) & 7]);
+               out.push_back(digits[c & 7]);
+            } else {
+               out.push_back((char)c);
+            }
+            break;
+      }
+   }
+   out.push_back('"');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+class CppGenerator final {
+public:
+   CppGenerator(const S& lua, const S& writer, const S& source_name, const std::vector<SourceLocation>& lines)
+      : lua_(lua),
+        writer_(writer),
+        source_name_(source_name),
+        lines_(lines),
+        tokens_(lex_lua(lua)) { }
+
+   void generate(S& body) {
+      while (i_ < tokens_.size()) {
+         const LuaToken& token = tokens_[i_];
+         if (is_(";")) {
+            ++i_;
+         } else if (is_("do")) {
+            ++i_;
+            body.append(indent_()).append("{\n");
+            open_(Block::plain);
+         } else if (is_("if")) {
+            ++i_;
+            S condition = condition_("then");
+            body.append(indent_()).append("if (").append(condition).append(") {\n");
+            open_(Block::conditional);
+         } else if (is_("elseif") || is_("else")) {
+            if (blocks_.empty() || blocks_.back().type != Block::conditional) {
+               unsupported_(i_, "'" + token_text(lua_, token) + "' here");
+            }
+            blocks_.pop_back();
+            if (is_("else")) {
+               ++i_;
+               body.append(indent_()).append("} else {\n");
+            } else {
+               ++i_;
+               S condition = condition_("then");
+               body.append(indent_()).append("} else if (").append(condition).append(") {\n");
+            }
+            open_(Block::conditional);
+         } else if (is_("end") && !blocks_.empty()) {
+            ++i_;
+            locals_.resize(blocks_.back().locals);
+            blocks_.pop_back();
+            body.append(indent_()).append("}\n");
+         } else if (is_("for")) {
+            for_(body);
+         } else if (token.type == LuaTokenType::name && is_token(lua_, token, writer_)) {
+            write_(body);
+         } else {
+            unsupported_(i_, "'" + token_text(lua_, token) + "'");
+         }
+      }
+
+      if (!blocks_.empty()) {
+         unsupported_(tokens_.size(), "a block without 'end'");
+      }
+   }
+
+private:
+   struct Block {
+      enum Type { plain, conditional, loop } type;
+      std::size_t locals;
+   };
+
+   bool is_(const char* text) const {
+      return i_ < tokens_.size() && is_token(lua_, tokens_[i_], text);
+   }
+
+   bool is_name_() const {
+      return i_ < tokens_.size() && tokens_[i_].type == LuaTokenType::name;
+   }
+
+   void expect_(const char* text) {
+      if (!is_(text)) {
+         unsupported_(i_, "this statement");
+      }
+      ++i_;
+   }
+
+   S indent_() const {
+      return S(3 * (blocks_.size() + 1), ' ');
+   }
+
+   void open_(Block::Type type) {
+      blocks_.push_back({ type, locals_.size() });
+   }
+
+   // Lua locals are prefixed so they can't clash with out, ctx or C++ keywords
+   S local_name_() {
+      if (!is_name_()) {
+         unsupported_(i_, "this statement");
+      }
+      return "l_" + token_text(lua_, tokens_[i_++]);
+   }
+
+   void for_(S& body) {
+      std::size_t start = i_++;
+      std::size_t name_index = i_;
+      S name = local_name_();
+
+      if (is_("=")) {
+         ++i_;
+         S first = additive_();
+         expect_(",");
+         S limit = additive_();
+         S step = "1";
+         bool is_negative = false;
+         if (is_(",")) {
+            ++i_;
+            if (is_("-")) {
+               is_negative = true;
+               ++i_;
+            }
+            if (i_ >= tokens_.size() || tokens_[i_].type != LuaTokenType::number) {
+               unsupported_(i_ < tokens_.size() ? i_ : start, "a loop step that isn't a number");
+            }
+            step = token_text(lua_, tokens_[i_++]);
+            if (step.find_first_not_of("0.xX") == S::npos) {
+               unsupported_(start, "a loop step of zero");
+            }
+         }
+         expect_("do");
+
+         // As in Lua 5.3+, the loop variable is an integer unless the start or
+         // step is a float, and the limit is evaluated once; integer limits are
+         // rounded toward the start so they compare as integers.
+         bool is_float = is_float_literal(first) || is_float_literal(step);
+         S limit_name = "limit_" + std::to_string(loops_++);
+         body.append(indent_()).append("const auto ").append(limit_name).append(" = ");
+         if (is_float) {
+            body.append("static_cast<double>(").append(limit).append(");\n");
+         } else {
+            body.append("bltc_generated::integer_limit(").append(limit).append(is_negative ? ", true);\n" : ", false);\n");
+         }
+         body.append(indent_()).append("for (").append(is_float ? "double " : "long long ").append(name)
+             .append(" = ").append(first).append("; ").append(name).append(is_negative ? " >= " : " <= ")
+             .append(limit_name).append("; ").append(name).append(is_negative ? " -= " : " += ").append(step).append(") {\n");
+         open_(Block::loop);
+         locals_.push_back({ token_text(lua_, tokens_[name_index]), name });
+         return;
+      }
+
+      std::size_t value_index = S::npos;
+      S value;
+      if (is_(",")) {
+         ++i_;
+         value_index = i_;
+         value = local_name_();
+      }
+      expect_("in");
+      if (!is_("ipairs")) {
+         unsupported_(i_ < tokens_.size() ? i_ : start, "generic for loops other than ipairs");
+      }
+      ++i_;
+      expect_("(");
+      S array = primary_();
+      expect_(")");
+      expect_("do");
+
+      body.append(indent_()).append("for (long long ").append(name).append(" = 1; ").append(name)
+          .append(" <= static_cast<long long>(std::size(").append(array).append(")); ++").append(name).append(") {\n");
+      open_(Block::loop);
+      locals_.push_back({ token_text(lua_, tokens_[name_index]), name });
+      if (!value.empty()) {
+         body.append(indent_()).append("const auto& ").append(value).append(" = ").append(array)
+             .append("[").append(name).append(" - 1];\n");
+         body.append(indent_()).append("(void)").append(value).append(";\n");
+         locals_.push_back({ token_text(lua_, tokens_[value_index]), value });
+      }
+   }
+
+   void write_(S& body) {
+      std::size_t call = i_++;
+      bool parens = is_("(");
+      if (parens) {
+         ++i_;
+      }
+
+      if (i_ < tokens_.size() && tokens_[i_].type == LuaTokenType::string && (!parens || (i_ + 1 < tokens_.size() &&
+                                                                                          is_token(lua_, tokens_[i_ + 1], ")")))) {
+         S value = decode_lua_string(lua_, tokens_[i_]);
+         ++i_;
+         for (std::size_t offset = 0; offset < value.size(); offset += max_literal_size) {
+            S chunk = value.substr(offset, max_literal_size);
+            S indent = indent_();
+            body.append(indent).append("out.write(");
+            append_cpp_string(body, chunk, indent + "          ");
+            body.append(", ").append(std::to_string(chunk.size())).append(");\n");
+         }
+      } else if (parens) {
+         std::size_t begin = i_;
+         logical_ = false;
+         S expr = expression_();
+         if (logical_) {
+            // 'and' and 'or' produce one of their operands in Lua, but a bool in C++
+            unsupported_(begin, "writing the result of 'and' or 'or'");
+         }
+         body.append(indent_()).append("bltc_generated::write_value(out, ").append(expr).append(");\n");
+      } else {
+         unsupported_(i_ < tokens_.size() ? i_ : call, "this argument to " + writer_ + "()");
+      }
+
+      if (parens) {
+         if (!is_(")")) {
+            unsupported_(i_ < tokens_.size() ? i_ : call, "this expression");
+         }
+         ++i_;
+      }
+   }
+
+   S condition_(const char* terminator) {
+      S condition = expression_();
+      expect_(terminator);
+      return condition;
+   }
+
+   S expression_() {
+      S lhs = and_();
+      while (is_("or")) {
+         ++i_;
+         logical_ = true;
+         lhs = "(" + lhs + " || " + and_() + ")";
+      }
+      return lhs;
+   }
+
+   S and_() {
+      S lhs = comparison_();
+      while (is_("and")) {
+         ++i_;
+         logical_ = true;
+         lhs = "(" + lhs + " && " + comparison_() + ")";
+      }
+      return lhs;
+   }
+
+   S comparison_() {
+      S lhs = additive_();
+      for (;;) {
+         const char* op = nullptr;
+         for (const char* candidate : { "==", "<", "<=", ">", ">=" }) {
+            if (is_(candidate)) {
+               op = candidate;
+            }
+         }
+         if (is_("~=")) {
+            op = "!=";
+         }
+         if (!op) {
+            return lhs;
+         }
+         ++i_;
+         lhs = "(" + lhs + " " + op + " " + additive_() + ")";
+      }
+   }
+
+   S additive_() {
+      S lhs = multiplicative_();
+      while (is_("+") || is_("-")) {
+         S op = token_text(lua_, tokens_[i_++]);
+         lhs = "(" + lhs + " " + op + " " + multiplicative_() + ")";
+      }
+      return lhs;
+   }
+
+   S multiplicative_() {
+      S lhs = unary_();
+      for (;;) {
+         if (is_("*")) {
+            ++i_;
+            lhs = "(" + lhs + " * " + unary_() + ")";
+         } else if (is_("/")) {
+            // '/' is always float division in Lua
+            ++i_;
+            lhs = "(static_cast<double>(" + lhs + ") / " + unary_() + ")";
+         } else {
+            return lhs;
+         }
+      }
+   }
+
+   S unary_() {
+      if (is_("not")) {
+         ++i_;
+         return "!(" + unary_() + ")";
+      } else if (is_("-")) {
+         ++i_;
+         return "-(" + unary_() + ")";
+      } else if (is_("#")) {
+         ++i_;
+         return "static_cast<long long>(std::size(" + unary_() + "))";
+      }
+      return primary_();
+   }
+
+   S primary_() {
+      if (i_ >= tokens_.size()) {
+         unsupported_(tokens_.size() - 1, "this expression");
+      }
+
+      const LuaToken& token = tokens_[i_];
+      if (token.type == LuaTokenType::number) {
+         ++i_;
+         return token_text(lua_, token);
+      } else if (token.type == LuaTokenType::string) {
+         ++i_;
+         S value = decode_lua_string(lua_, token);
+         S literal = "std::string_view(";
+         append_cpp_string(literal, value, S());
+         return literal.append(", ").append(std::to_string(value.size())).append(")");
+      } else if (is_("true") || is_("false")) {
+         ++i_;
+         return token_text(lua_, token);
+      } else if (is_("(")) {
+         ++i_;
+         S expr = expression_();
+         if (!is_(")")) {
+            unsupported_(i_ < tokens_.size() ? i_ : tokens_.size() - 1, "this expression");
+         }
+         ++i_;
+         return "(" + expr + ")";
+      } else if (token.type != LuaTokenType::name) {
+         unsupported_(i_, "'" + token_text(lua_, token) + "' in an expression");
+      }
+
+      S expr;
+      S name = token_text(lua_, token);
+      auto local = std::find_if(locals_.rbegin(), locals_.rend(),
+         [&](const std::pair<S, S>& l) { return l.first == name; });
+      if (local != locals_.rend()) {
+         expr = local->second;
+      } else {
+         if (is_cpp_keyword(name)) {
+            unsupported_(i_, "the name '" + name + "', which is a C++ keyword");
+         }
+         expr = "ctx." + name;
+      }
+      ++i_;
+
+      while (i_ + 1 < tokens_.size() && is_(".") && tokens_[i_ + 1].type == LuaTokenType::name) {
+         ++i_;
+         name = token_text(lua_, tokens_[i_]);
+         if (is_cpp_keyword(name)) {
+            unsupported_(i_, "the name '" + name + "', which is a C++ keyword");
+         }
+         expr.append(".").append(name);
+         ++i_;
+      }
+
+      if (is_("(") || is_("[") || is_(":") || (i_ < tokens_.size() && tokens_[i_].type == LuaTokenType::string)) {
+         unsupported_(i_, "function calls and indexing");
+      }
+      return expr;
+   }
+
+   [[noreturn]] void unsupported_(std::size_t index, const S& what) {
+      // code ending partway through a statement is reported at its last token
+      std::size_t offset = tokens_.empty() ? 0 : tokens_[std::min(index, tokens_.size() - 1)].begin;
+      std::size_t line = count_newlines(lua_, 0, offset);
+      S where = source_name_;
+      if (line < lines_.size() && lines_[line].line != 0) {
+         where.append(":").append(std::to_string(lines_[line].line)).append(":").append(std::to_string(lines_[line].column));
+      }
+      where.append(" (generated Lua line ").append(std::to_string(line + 1)).append(")");
+      throw std::runtime_error(where + ": the C++ backend doesn't support " + what + "; templates may only contain "
+                               "literal text, writes of simple expressions, if statements, numeric for loops, and "
+                               "ipairs loops over arrays");
+   }
+
+   const S& lua_;
+   const S& writer_;
+   const S& source_name_;
+   const std::vector<SourceLocation>& lines_;
+   std::vector<LuaToken> tokens_;
+   std::size_t i_ = 0;
+   std::vector<Block> blocks_;
+   std::vector<std::pair<S, S>> locals_; // Lua name -> C++ name
+   bool logical_ = false;
+   std::size_t loops_ = 0;
+};
+
+// Included by every generated header; writes values the way Lua's tostring
+// formats them, so rendering in C++ gives the same output as in Lua.
+const char* const write_value_helper =
+   "#ifndef BLTC_GENERATED_WRITE_VALUE_\n"
+   "#define BLTC_GENERATED_WRITE_VALUE_\n"
+   "\n"
+   "#include <cmath>\n"
+   "#include <cstdio>\n"
+   "#include <cstring>\n"
+   "#include <iterator>\n"
+   "#include <string_view>\n"
+   "#include <type_traits>\n"
+   "\n"
+   "namespace bltc_generated {\n"
+   "\n"
+   "// Integers are written in decimal, other numbers with \"%.14g\" (plus \".0\"\n"
+   "// if that looks like an integer) and bools as true or false, as in Lua 5.3+.\n"
+   "template <typename Buffer, typename T>\n"
+   "void write_value(Buffer& out, const T& value) {\n"
+   "   if constexpr (std::is_same_v<T, bool>) {\n"
+   "      if (value) {\n"
+   "         out.write(\"true\", 4);\n"
+   "      } else {\n"
+   "         out.write(\"false\", 5);\n"
+   "      }\n"
+   "   } else if constexpr (std::is_integral_v<T>) {\n"
+   "      char buf[32];\n"
+   "      int n = std::is_signed_v<T> ? std::snprintf(buf, sizeof(buf), \"%lld\", static_cast<long long>(value))\n"
+   "                                  : std::snprintf(buf, sizeof(buf), \"%llu\", static_cast<unsigned long long>(value));\n"
+   "      out.write(buf, n);\n"
+   "   } else if constexpr (std::is_floating_point_v<T>) {\n"
+   "      char buf[48];\n"
+   "      int n = std::snprintf(buf, sizeof(buf), \"%.14g\", static_cast<double>(value));\n"
+   "      if (buf[std::strspn(buf, \"-0123456789\")] == '\\0') {\n"
+   "         buf[n++] = '.';\n"
+   "         buf[n++] = '0';\n"
+   "      }\n"
+   "      out.write(buf, n);\n"
+   "   } else {\n"
+   "      out << value;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "// The limit of an integer for loop; floats are rounded toward the start.\n"
+   "template <typename T>\n"
+   "long long integer_limit(const T& limit, bool descending) {\n"
+   "   if constexpr (std::is_floating_point_v<T>) {\n"
+   "      return static_cast<long long>(descending ? std::ceil(limit) : std::floor(limit));\n"
+   "   } else {\n"
+   "      return static_cast<long long>(limit);\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "} // bltc_generated\n"
+   "\n"
+   "#endif\n";
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Turns an arbitrary name into a valid C++ identifier.
+S cpp_identifier(const S& name) {
+   S id;
+   for (char c : name) {
+      id.push_back(std::isalnum((unsigned char)c) ? c : '_');
+   }
+   if (id.empty() || std::isdigit((unsigned char)id[0]) || is_cpp_keyword(id)) {
+      id.insert(id.begin(), '_');
+   }
+   return id;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Translates compiled template code into a C++ function template.
+///
+/// \details The generated header declares
+///         template <typename Buffer, typename Context>
+///         void function_name(Buffer& out, const Context& ctx)
+///         which writes literal text with out.write(const char*, size).
+///         Globals read by the template become ctx.name (fields become
+///         ctx.name.field), and other values are written as Lua's tostring
+///         would for numbers and bools, or with out << value otherwise, so a
+///         std::ostream can be used as the buffer.
+///
+///         Supported statements are writes of string literals and simple
+///         expressions (names, field chains, literals, arithmetic,
+///         comparisons, not, and, or, and # for sizes), do ... end blocks,
+///         if/elseif/else, numeric for loops with a constant step, and
+///         for i, v in ipairs(array) loops, where array must support
+///         std::size and operator[].  Conditions are evaluated as in C++
+///         rather than Lua (where 0 and "" are true), so numbers and strings
+///         should be compared explicitly.
+///         Anything else throws std::runtime_error, with a location from
+///         lines when available.  lua should not have been processed by the
+///         hoist pass or the buffer emit strategy.
+void generate_cpp(const S& lua, const S& writer, const S& function_name, const S& source_name,
+                  const std::vector<SourceLocation>& lines, S& out) {
+   S body;
+   CppGenerator(lua, writer, source_name, lines).generate(body);
+
+   out.clear();
+   out.append("// Generated by bltc from ").append(source_name).append("; do not edit.\n");
+   out.append("#pragma once\n\n");
+   out.append(write_value_helper);
+   out.append("\n");
+   out.append("template <typename Buffer, typename Context>\n");
+   out.append("void ").append(function_name).append("(Buffer& out, const Context& ctx) {\n");
+   out.append("   (void)ctx;\n");
+   out.append(body);
+   out.append("}\n");
+}
+
+} // be::bltc
+} // be
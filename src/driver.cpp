@@ -0,0 +1,1045 @@
+#include "driver.hpp"
+#include "bench.hpp"
+#include "source_map.hpp"
+#include "cpp_backend.hpp"
+#include "framing.hpp"
+#include <be/core/logging.hpp>
+#include <be/core/log_exception.hpp>
+#include <be/util/path_glob.hpp>
+#include <be/core/alg.hpp>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+
+namespace be {
+namespace bltc {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// Reads stdin in chunks straight into the returned string, so the input is
+/// only held in memory once.  Capacity beyond the input's size is never
+/// written, so it doesn't take up physical memory.
+S process_stdin() {
+   S input;
+   char chunk[64 * 1024];
+   do {
+      std::cin.read(chunk, sizeof(chunk));
+      input.append(chunk, (std::size_t)std::cin.gcount());
+   } while (std::cin);
+
+   if (std::cin.bad()) {
+      throw std::ios::failure("Error while reading from stdin!");
+   }
+
+   return input;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const S& get_stdin() {
+   static const S input = process_stdin();
+   return input;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void append_make_path(S& out, const S& path) {
+   for (char c : path) {
+      if (c == ' ' || c == '#') {
+         out.push_back('\\');
+      } else if (c == '$') {
+         out.push_back('$');
+      }
+      out.push_back(c);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+S expand_variant_pattern(const S& pattern, const S& name, const S& ext, const S& variant) {
+   S result;
+   std::size_t offset = 0;
+   for (;;) {
+      std::size_t begin = pattern.find('{', offset);
+      std::size_t end = begin == S::npos ? S::npos : pattern.find('}', begin);
+      if (end == S::npos) {
+         result.append(pattern, offset, S::npos);
+         return result;
+      }
+
+      result.append(pattern, offset, begin - offset);
+      S key = pattern.substr(begin + 1, end - begin - 1);
+      if (key == "name") {
+         result.append(name);
+      } else if (key == "ext") {
+         result.append(ext);
+      } else if (key == "variant") {
+         result.append(variant);
+      } else {
+         result.append(pattern, begin, end - begin + 1);
+      }
+      offset = end + 1;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const char* artifact_extension(Driver::Artifact artifact) {
+   switch (artifact) {
+      case Driver::Artifact::bytecode: return "luac";
+      case Driver::Artifact::cpp:      return "hpp";
+      case Driver::Artifact::tree:     return "tree";
+      default:                          return "lua";
+   }
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+Driver::Options::Options() {
+   codegen.inline_max_size = default_inline_max_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Checks the options for conflicts and prepares them for use.
+///
+/// \details Throws std::runtime_error if the options can't be used together.
+///         No inputs are read until the driver is invoked.
+Driver::Driver(Options options, std::vector<Job> jobs)
+   : options_(std::move(options)),
+     jobs_(std::move(jobs)),
+     search_index_(options_.search_paths),
+     console_(options_.console ? options_.console : &std::cout) {
+
+   if (!options_.variants.empty() && !options_.bundle_dest.empty()) {
+      throw std::runtime_error("Variants can't be combined with a bundle");
+   }
+
+   if (options_.run) {
+      if (!options_.variants.empty()) {
+         throw std::runtime_error("Rendering can't be combined with variants");
+      }
+      if (!options_.bundle_dest.empty()) {
+         throw std::runtime_error("Rendering can't be combined with a bundle");
+      }
+      options_.emit.fill(false);
+      options_.emit[(std::size_t)Artifact::lua] = true;
+   }
+
+   if (options_.bench_renders > 0) {
+      if (options_.run) {
+         throw std::runtime_error("Benchmarking can't be combined with rendering");
+      }
+      if (!options_.bundle_dest.empty()) {
+         throw std::runtime_error("Benchmarking can't be combined with a bundle");
+      }
+   }
+
+   if (!options_.check && options_.bench_renders == 0) {
+      for (const Job& job : jobs_) {
+         bool console_dest = job.dest_type == DestType::console
+            || (job.dest_type == DestType::path && job.dest.empty()
+                && (job.source_type == SourceType::raw || job.source_type == SourceType::console));
+         if (!console_dest) {
+            continue;
+         }
+
+         // outputs written to stdout back to back couldn't be told apart
+         std::size_t console_outputs = 0;
+         for (std::size_t i = 0; i < options_.emit.size(); ++i) {
+            if (options_.emit[i] && job.artifact_dests[i].empty()) {
+               console_outputs += (Artifact)i == Artifact::tree ? 1 : std::max(options_.variants.size(), (std::size_t)1);
+            }
+         }
+         if (console_outputs > 1) {
+            throw std::runtime_error("Only one output can be written to stdout; the other artifacts and variants need output paths");
+         }
+      }
+   }
+
+   auto check_codegen = [](const CodegenOptions& codegen) {
+      if (codegen.string_buffer && codegen.target != CodegenOptions::Target::luajit) {
+         throw std::runtime_error("String buffers can only be used with the luajit target");
+      }
+   };
+   check_codegen(options_.codegen);
+   for (const Variant& variant : options_.variants) {
+      check_codegen(variant.codegen);
+   }
+
+   bool console_input = false;
+   bool frames_input = false;
+   for (const Job& job : jobs_) {
+      console_input |= job.source_type == SourceType::console;
+      frames_input |= job.source_type == SourceType::frames;
+   }
+   if (console_input && frames_input) {
+      throw std::runtime_error("Only one job may read from stdin");
+   }
+
+   for (const Job& job : jobs_) {
+      if (job.source_type == SourceType::frames && (job.dest_type != DestType::path || !job.dest.empty())) {
+         throw std::runtime_error("Framed inputs take their destinations from each frame, so they can't be sent to "
+                                  "stdout, a bundle, or an output path");
+      }
+   }
+
+   auto resolve_include = [this](const S& name, Path& path) {
+      std::vector<Path> paths = search_index_.resolve(name);
+      if (paths.empty()) {
+         paths = search_index_.resolve(name + ".blt");
+      }
+      if (paths.empty()) {
+         return false;
+      }
+      path = paths.front();
+      return true;
+   };
+
+   if (!options_.codegen.include_function.empty()) {
+      options_.codegen.resolve_include = resolve_include;
+   }
+   for (Variant& variant : options_.variants) {
+      if (!variant.codegen.include_function.empty()) {
+         variant.codegen.resolve_include = resolve_include;
+      }
+   }
+
+   options_.render.writer = options_.codegen.writer;
+   bundle_.intern(options_.intern_min_length);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+I8 Driver::operator()() {
+   if (status_ != 0) {
+      return status_;
+   }
+
+   try {
+      if (options_.search_paths.empty()) {
+         options_.search_paths.push_back(util::cwd());
+      }
+
+      for (const Path& p : options_.search_paths) {
+         be_short_verbose() << "Search path: " << color::fg_gray << p.generic_string() | default_log();
+      }
+
+      if (!options_.output_path.empty()) {
+         options_.output_path = fs::absolute(options_.output_path);
+         if (!fs::exists(options_.output_path)) {
+            fs::create_directories(options_.output_path);
+         }
+         if (!fs::is_directory(options_.output_path)) {
+            error_(options_.output_path.string(), 5,
+                   std::make_exception_ptr(std::runtime_error("Output path is not a directory")));
+            return status_;
+         }
+
+         be_short_verbose() << "Output path: " << color::fg_gray << options_.output_path.generic_string() | default_log();
+      }
+   } catch (...) {
+      error_(S(), 1, std::current_exception());
+   }
+
+   if (status_ != 0) {
+      return status_;
+   }
+
+   if ((options_.run || options_.bench_renders > 0) && !options_.data_path.empty() && !options_.check) {
+      options_.data_path = fs::absolute(options_.data_path);
+      be_short_verbose() << "Loading data file: " << color::fg_gray << options_.data_path.generic_string() | default_log();
+
+      try {
+         std::ifstream ifs(options_.data_path.native(), std::ios::binary);
+         if (!ifs) {
+            throw std::ios::failure("Could not open file: " + options_.data_path.string());
+         }
+
+         std::ostringstream oss;
+         oss << ifs.rdbuf();
+         if (ifs.bad()) {
+            throw std::ios::failure("Error while reading file: " + options_.data_path.string());
+         }
+
+         options_.render.data = oss.str();
+         options_.render.data_chunk_name = "@" + options_.data_path.generic_string();
+      } catch (...) {
+         error_(options_.data_path.string(), 4, std::current_exception());
+         return status_;
+      }
+
+      try {
+         // report errors in the data file once, rather than for every input
+         Renderer renderer(options_.render);
+      } catch (...) {
+         error_(options_.data_path.string(), 7, std::current_exception());
+         return status_;
+      }
+   }
+
+   try {
+      for (auto& job : jobs_) {
+         process_(job);
+      }
+      if (!options_.bundle_dest.empty() && !options_.check) {
+         write_bundle_();
+      }
+      if (!options_.depfile_dest.empty() && !options_.check) {
+         write_depfile_();
+      }
+   } catch (...) {
+      error_(S(), 1, std::current_exception());
+   }
+
+   return status_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Driver::process_(Job& job) {
+   try {
+      if (job.source_type == SourceType::path) {
+         Path source = util::parse_path(job.source);
+
+         be_short_verbose() << "Processing input path: " << color::fg_gray << S(job.source) | default_log();
+
+         if (source.is_absolute() && fs::exists(source)) {
+            process_path_(source, job);
+            return;
+         }
+
+         std::vector<Path> paths = search_index_.resolve(job.source);
+         if (!paths.empty()) {
+
+            if (paths.size() > 1) {
+               for (const Path& p : paths) {
+                  be_short_verbose() << "Expanded input path match: " << color::fg_gray << p.generic_string() | default_log();
+               }
+            }
+
+            for (Path& p : paths) {
+               Job copy = job;
+               process_path_(p, copy);
+            }
+            return;
+         }
+
+         if (options_.on_error || frame_log_) {
+            error_(job.source, 3, std::make_exception_ptr(std::runtime_error("No files found matching " + source.generic_string())));
+            return;
+         }
+
+         // logged as a warning, with the search paths that were tried
+         status_ = std::max(status_, I8(3));
+
+         LogRecord rec;
+         be_warn() << "No files found matching " << color::fg_gray << source.generic_string() || rec;
+
+         for (Path& p : options_.search_paths) {
+            log_nil() & attr(ids::log_attr_search_path) << p.generic_string() || rec;
+         }
+
+         rec | default_log();
+
+      } else if (job.source_type == SourceType::frames) {
+         be_short_verbose() << "Processing templates framed on stdin"
+            | default_log();
+
+         process_frames_(job);
+      } else if (job.source_type == SourceType::console) {
+         be_short_verbose() << "Processing stdin"
+            | default_log();
+
+         process_non_path_(get_stdin(), job);
+      } else {
+         be_short_verbose() << "Processing template from command line"
+            | default_log();
+
+         process_non_path_(job.source, job);
+      }
+
+   } catch (const fs::filesystem_error&) {
+      error_(job.source, 4, std::current_exception());
+   } catch (...) {
+      error_(job.source, 1, std::current_exception());
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Driver::process_path_(const Path& path, Job& job) {
+   try {
+      if (!options_.bundle_dest.empty()) {
+         job.dest = bundle_name_(path);
+         job.dest_type = DestType::bundle;
+      } else if (job.dest_type == DestType::path && !options_.check && options_.bench_renders == 0) {
+         Path dest;
+         if (job.dest.empty()) {
+            if (options_.output_path.empty()) {
+               dest = path;
+            } else {
+               dest = options_.output_path;
+               dest /= path;
+            }
+
+            if (!options_.run) {
+               dest.replace_extension(artifact_extension(primary_artifact_()));
+            } else if (dest.has_extension()) {
+               dest.replace_extension();
+            } else {
+               dest += ".out";
+            }
+
+         } else {
+            dest = job.dest;
+            if (dest.is_relative() && !options_.output_path.empty()) {
+               dest = options_.output_path;
+               dest /= job.dest;
+            }
+         }
+         job.dest = dest.string();
+      }
+   } catch (...) {
+      error_(path.string(), 4, std::current_exception());
+   }
+
+   be_short_verbose() << "Loading file: " << color::fg_gray << path.generic_string() | default_log();
+
+   Task task;
+   task.job = job;
+   task.path = path;
+   submit_(task);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Each template is compiled before the next frame is read, and its console
+/// output and errors are collected for its response.  Nothing else can write
+/// to stdout while frames are being written.
+void Driver::process_frames_(const Job& job) {
+   set_binary_stdio();
+   FrameOutput frames;
+
+   S frame;
+   S data;
+   S output;
+   S log;
+   S response;
+   std::ostream* console = console_;
+   while (read_frame(std::cin, frame)) {
+      output.clear();
+      log.clear();
+      I8 status = status_;
+      status_ = 0;
+      {
+         StringBuffer out_buf(output);
+         std::ostream out(&out_buf);
+         console_ = &out;
+         frame_log_ = &log;
+         try {
+            std::size_t header_end = frame.find('\0');
+            if (header_end == S::npos) {
+               throw std::ios::failure("Template frame has no destination header");
+            }
+
+            Job doc = job;
+            doc.dest = frame.substr(0, header_end);
+            data.assign(frame, header_end + 1, S::npos);
+            process_non_path_(data, doc);
+         } catch (...) {
+            error_(S(), 4, std::current_exception());
+         }
+         console_ = console;
+         frame_log_ = nullptr;
+      }
+
+      response.clear();
+      append_u32(response, (U32)status_);
+      append_u32(response, (U32)output.size());
+      response.append(output);
+      response.append(log);
+      write_frame(frames.stream(), response);
+
+      status_ = std::max(status, status_);
+   }
+}
+
+void Driver::process_non_path_(const S& data, Job& job) {
+   if (job.dest_type == DestType::path && !options_.check && options_.bench_renders == 0) {
+      if (job.dest.empty()) {
+         job.dest_type = DestType::console;
+      } else {
+         Path dest = job.dest;
+         if (dest.is_relative() && !options_.output_path.empty()) {
+            dest = options_.output_path;
+            dest /= job.dest;
+         }
+         job.dest = dest.string();
+      }
+   }
+
+   Task task;
+   task.job = job;
+   task.data = &data;
+   submit_(task);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Driver::submit_(Task& task) {
+   if (options_.check) {
+      be_short_verbose() << "Checking template"
+         | default_log();
+   } else if (options_.bench_renders > 0) {
+      be_short_verbose() << "Benchmarking template"
+         | default_log();
+   } else if (task.job.dest_type == DestType::bundle) {
+      be_short_verbose() << "Adding to bundle as " << color::fg_gray << task.job.dest | default_log();
+   } else {
+      for (std::size_t v = 0; v < std::max(options_.variants.size(), (std::size_t)1); ++v) {
+         const Variant* variant = options_.variants.empty() ? nullptr : &options_.variants[v];
+         for (std::size_t i = 0; i < options_.emit.size(); ++i) {
+            if (!options_.emit[i] || (variant && v > 0 && (Artifact)i == Artifact::tree)) {
+               continue;
+            }
+
+            S dest;
+            if (artifact_dest_(task.job, (Artifact)i, dest, variant) == DestType::path) {
+               be_short_verbose() << "Opening output file: " << color::fg_gray << dest | default_log();
+               task.dests.push_back(Path(dest));
+            } else {
+               be_short_verbose() << "Outputting to stdout"
+                  | default_log();
+            }
+         }
+      }
+   }
+
+   execute_(task);
+   finish_(task);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Loads, compiles, and writes the outputs for a task.  Errors are recorded
+/// in the task and reported by finish_().
+void Driver::execute_(Task& task) const {
+   Compiler& compiler = Compiler::for_thread();
+   compile_(task, compiler);
+   compiler.reset();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Driver::compile_(Task& task, Compiler& compiler) const {
+   const S* data = task.data;
+   if (!data) {
+      try {
+         data = &compiler.load(task.path);
+      } catch (...) {
+         task.errors.emplace_back((I8)4, std::current_exception());
+         compiler.clear_input();
+         data = &compiler.input();
+      }
+   }
+
+   if (options_.check) {
+      try {
+         compiler.check(*data);
+      } catch (...) {
+         task.errors.emplace_back((I8)6, std::current_exception());
+      }
+      return;
+   }
+
+   if (options_.bench_renders > 0) {
+      bench_(task, compiler, *data);
+      return;
+   }
+
+   if (options_.run) {
+      render_(task, compiler, *data);
+      return;
+   }
+
+   if (task.job.dest_type == DestType::bundle) {
+      try {
+         task.output = compiler.compile(*data, options_.codegen);
+         task.dependencies = compiler.dependencies();
+      } catch (...) {
+         task.errors.emplace_back((I8)6, std::current_exception());
+      }
+      return;
+   }
+
+   // When there are variants, the BLT compiler only runs once; each variant's
+   // options are then applied to its output.  Source maps, and locations in
+   // C++ backend errors, are also found from the unoptimized output.
+   bool emit_cpp = options_.emit[(std::size_t)Artifact::cpp];
+   bool needs_generated = !options_.variants.empty() || options_.source_map || emit_cpp;
+   const S* generated = nullptr;
+   std::vector<SourceLocation> source_lines;
+   S source_name = task.job.source_type == SourceType::path ? task.path.generic_string() : chunk_name_(task).substr(1);
+   if (needs_generated && (options_.emit[(std::size_t)Artifact::lua] || options_.emit[(std::size_t)Artifact::bytecode] || emit_cpp)) {
+      try {
+         generated = &compiler.generate(*data);
+         if (options_.source_map || emit_cpp) {
+            source_lines = map_source_lines(*generated, options_.codegen.writer, *data);
+         }
+      } catch (...) {
+         task.errors.emplace_back((I8)6, std::current_exception());
+      }
+   }
+
+   auto add_dependencies = [&](const std::vector<Path>& dependencies) {
+      for (const Path& dependency : dependencies) {
+         if (std::find(task.dependencies.begin(), task.dependencies.end(), dependency) == task.dependencies.end()) {
+            task.dependencies.push_back(dependency);
+         }
+      }
+   };
+
+   for (std::size_t v = 0; v < std::max(options_.variants.size(), (std::size_t)1); ++v) {
+      const Variant* variant = options_.variants.empty() ? nullptr : &options_.variants[v];
+
+      // bytecode is generated from the compiled Lua, so when both are emitted
+      // the template is only compiled once.  The parse tree still comes from a
+      // separate blt::debug_blt call, since blt doesn't expose its parser's
+      // output; parsing once for every artifact needs a new entry point there.
+      const S* lua = nullptr;
+      for (std::size_t i = 0; i < options_.emit.size(); ++i) {
+         Artifact artifact = (Artifact)i;
+         if (!options_.emit[i] || (artifact == Artifact::tree ? v > 0 : needs_generated && !generated)) {
+            continue;
+         }
+
+         S dest;
+         DestType dest_type = artifact_dest_(task.job, artifact, dest, variant);
+
+         std::ofstream ofs;
+         std::ostream* os = console_;
+         if (dest_type == DestType::path) {
+            try {
+               ofs.open(Path(dest).native(), std::ios::binary);
+            } catch (...) {
+               task.errors.emplace_back((I8)5, std::current_exception());
+               continue;
+            }
+            os = &ofs;
+         }
+
+         if (!(*os)) {
+            continue;
+         }
+
+         try {
+            const S* output;
+            S cpp;
+            if (artifact == Artifact::tree) {
+               output = &compiler.debug(*data);
+               lua = nullptr;
+            } else if (artifact == Artifact::cpp) {
+               // the C++ backend can't translate hoisted locals or output buffers
+               CodegenOptions options = variant ? variant->codegen : options_.codegen;
+               options.hoist_globals = false;
+               options.strategy = CodegenOptions::Strategy::direct;
+               S stem = task.job.source_type == SourceType::path ? Path(source_name).stem().string() : S("render");
+               S name = cpp_identifier(stem + (variant ? "_" + variant->name : S()));
+               const S& optimized = compiler.optimize(*generated, options);
+               add_dependencies(compiler.dependencies());
+               generate_cpp(optimized, options.writer, name, source_name, source_lines, cpp);
+               output = &cpp;
+               lua = nullptr;
+            } else {
+               if (!lua && !generated && artifact == Artifact::lua && !options_.emit[(std::size_t)Artifact::bytecode] &&
+                   !options_.emit[(std::size_t)Artifact::cpp]) {
+                  // nothing else needs the compiled code, so it can go straight to the output
+                  compiler.compile(*data, options_.codegen, *os);
+                  add_dependencies(compiler.dependencies());
+                  if (dest_type == DestType::path) {
+                     task.targets.push_back(dest);
+                  }
+                  continue;
+               }
+
+               if (!lua) {
+                  lua = generated ? &compiler.optimize(*generated, variant ? variant->codegen : options_.codegen)
+                                  : &compiler.compile(*data, options_.codegen);
+                  add_dependencies(compiler.dependencies());
+               }
+               output = lua;
+               if (artifact == Artifact::bytecode) {
+                  output = &compiler.dump(*lua, chunk_name_(task), options_.strip_bytecode);
+               }
+            }
+            os->write(output->data(), (std::streamsize)output->size());
+            if (dest_type == DestType::path) {
+               task.targets.push_back(dest);
+            }
+         } catch (...) {
+            task.errors.emplace_back((I8)6, std::current_exception());
+            continue;
+         }
+
+         if (options_.source_map && (artifact == Artifact::lua || artifact == Artifact::bytecode) && dest_type == DestType::path) {
+            S map_dest = dest + ".map";
+            try {
+               std::ofstream map_ofs;
+               map_ofs.exceptions(std::ios::failbit | std::ios::badbit);
+               map_ofs.open(Path(map_dest).native(), std::ios::binary);
+               write_source_map(map_ofs, source_name, source_lines);
+               map_ofs.close();
+               task.targets.push_back(map_dest);
+            } catch (...) {
+               task.errors.emplace_back((I8)5, std::current_exception());
+            }
+         }
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Compiles a template and runs it in a new Lua interpreter, writing what it
+/// renders to the task's destination.
+void Driver::render_(Task& task, Compiler& compiler, const S& data) const {
+   S output;
+   try {
+      const S& lua = compiler.compile(data, options_.codegen);
+      task.dependencies = compiler.dependencies();
+      if (!options_.data_path.empty()) {
+         task.dependencies.push_back(options_.data_path);
+      }
+
+      Renderer renderer(options_.render);
+      try {
+         renderer.load(lua, chunk_name_(task));
+      } catch (...) {
+         task.errors.emplace_back((I8)6, std::current_exception());
+         return;
+      }
+      renderer.render(output);
+   } catch (const LuaError&) {
+      task.errors.emplace_back((I8)7, std::current_exception());
+      return;
+   } catch (...) {
+      task.errors.emplace_back((I8)6, std::current_exception());
+      return;
+   }
+
+   std::ofstream ofs;
+   std::ostream* os = console_;
+   if (task.job.dest_type == DestType::path) {
+      try {
+         ofs.open(Path(task.job.dest).native(), std::ios::binary);
+      } catch (...) {
+         task.errors.emplace_back((I8)5, std::current_exception());
+         return;
+      }
+      os = &ofs;
+   }
+
+   if (!(*os)) {
+      return;
+   }
+
+   os->write(output.data(), (std::streamsize)output.size());
+   if (task.job.dest_type == DestType::path) {
+      task.targets.push_back(task.job.dest);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Benchmarks rendering a template with the BLT compiler's plain output and
+/// with each configured set of codegen options, and formats the results in
+/// task.output.
+void Driver::bench_(Task& task, Compiler& compiler, const S& data) const {
+   std::vector<std::pair<S, const CodegenOptions*>> configs;
+   CodegenOptions baseline;
+   baseline.writer = options_.codegen.writer;
+   configs.emplace_back("baseline", &baseline);
+   if (options_.variants.empty()) {
+      configs.emplace_back("configured", &options_.codegen);
+   } else {
+      for (const Variant& variant : options_.variants) {
+         configs.emplace_back(variant.name, &variant.codegen);
+      }
+   }
+
+   const S* generated;
+   try {
+      generated = &compiler.generate(data);
+   } catch (...) {
+      task.errors.emplace_back((I8)6, std::current_exception());
+      return;
+   }
+
+   std::size_t width = 0;
+   for (auto& config : configs) {
+      width = std::max(width, config.first.size());
+   }
+
+   std::ostringstream oss;
+   oss << chunk_name_(task).substr(1) << ": " << options_.bench_renders << " renders\n";
+   for (auto& config : configs) {
+      BenchResult result;
+      try {
+         const S& lua = compiler.optimize(*generated, *config.second);
+         LuaAllocStats stats;
+         Renderer renderer(options_.render, &stats);
+         try {
+            renderer.load(lua, chunk_name_(task));
+         } catch (...) {
+            task.errors.emplace_back((I8)6, std::current_exception());
+            continue;
+         }
+         result = benchmark(renderer, stats, options_.bench_renders);
+      } catch (const LuaError&) {
+         task.errors.emplace_back((I8)7, std::current_exception());
+         continue;
+      } catch (...) {
+         task.errors.emplace_back((I8)6, std::current_exception());
+         continue;
+      }
+
+      double renders = (double)result.renders;
+      double seconds = result.render_seconds + result.gc_seconds;
+      oss << "   " << std::left << std::setw((int)width) << config.first << std::right << std::fixed
+          << std::setprecision(0) << std::setw(12) << (seconds > 0 ? renders / seconds : 0) << " renders/s"
+          << std::setprecision(2) << std::setw(10) << seconds * 1e6 / renders << " us/render"
+          << std::setprecision(1) << std::setw(7) << (seconds > 0 ? 100 * result.gc_seconds / seconds : 0) << "% GC"
+          << std::setprecision(0) << std::setw(10) << result.bytes / renders << " B/render"
+          << std::setprecision(1) << std::setw(8) << result.allocations / renders << " allocs/render"
+          << std::setw(10) << result.output_size << " B output\n";
+   }
+
+   task.output = oss.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Driver::finish_(Task& task) {
+   // written outputs may be inputs for later jobs
+   for (const Path& dest : task.dests) {
+      search_index_.invalidate(dest.parent_path());
+   }
+
+   if (task.job.dest_type == DestType::bundle && task.errors.empty() && !options_.check) {
+      try {
+         bundle_.add(task.job.dest, task.output);
+      } catch (...) {
+         task.errors.emplace_back((I8)5, std::current_exception());
+      }
+      S().swap(task.output);
+
+      if (!options_.depfile_dest.empty()) {
+         bundle_dependencies_.push_back(task.path);
+         bundle_dependencies_.insert(bundle_dependencies_.end(), task.dependencies.begin(), task.dependencies.end());
+      }
+   } else if (options_.bench_renders > 0) {
+      *console_ << task.output;
+      S().swap(task.output);
+   } else if (!options_.depfile_dest.empty() && !task.targets.empty()) {
+      std::vector<Path> prerequisites;
+      if (task.job.source_type == SourceType::path) {
+         prerequisites.push_back(task.path);
+      }
+      prerequisites.insert(prerequisites.end(), task.dependencies.begin(), task.dependencies.end());
+      add_dependencies_(task.targets, prerequisites);
+   }
+
+   for (auto& error : task.errors) {
+      S source = task.job.source_type == SourceType::path ? task.path.string() : chunk_name_(task).substr(1);
+      error_(source, error.first, error.second);
+   }
+   task.errors.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Raises the status to at least status, and reports error to the response
+/// for the current frame, Options::on_error, or the log, in that order of
+/// preference.
+void Driver::error_(const S& source, I8 status, const std::exception_ptr& error) {
+   status_ = std::max(status_, status);
+
+   if (!frame_log_ && !options_.on_error) {
+      try {
+         std::rethrow_exception(error);
+      } catch (const FatalTrace& e) {
+         log_exception(e);
+      } catch (const RecoverableTrace& e) {
+         log_exception(e);
+      } catch (const fs::filesystem_error& e) {
+         log_exception(e);
+      } catch (const std::system_error& e) {
+         log_exception(e);
+      } catch (const std::exception& e) {
+         log_exception(e);
+      } catch (...) {
+         be_error() << "Unknown error" | default_log();
+      }
+      return;
+   }
+
+   S message = "Unknown error";
+   try {
+      std::rethrow_exception(error);
+   } catch (const std::exception& e) {
+      message = e.what();
+   } catch (...) { }
+
+   if (frame_log_) {
+      if (!source.empty()) {
+         frame_log_->append(source).append(": ");
+      }
+      frame_log_->append(message).append("\n");
+   } else {
+      options_.on_error(source, status, message);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Driver::write_bundle_() {
+   Path path = options_.bundle_dest;
+   if (path.is_relative() && !options_.output_path.empty()) {
+      path = options_.output_path;
+      path /= options_.bundle_dest;
+   }
+
+   be_short_verbose() << "Writing bundle of " << bundle_.size() << " templates to " << color::fg_gray << path.generic_string() | default_log();
+
+   try {
+      if (path.has_parent_path() && !fs::exists(path.parent_path())) {
+         fs::create_directories(path.parent_path());
+      }
+
+      std::ofstream ofs(path.native(), std::ios::binary);
+      if (!ofs) {
+         throw std::ios::failure("Could not open file: " + path.string());
+      }
+
+      bundle_.write(ofs);
+      ofs.close();
+      if (ofs.fail()) {
+         throw std::ios::failure("Error while writing file: " + path.string());
+      }
+
+      if (!options_.depfile_dest.empty()) {
+         add_dependencies_({ path.string() }, bundle_dependencies_);
+      }
+   } catch (...) {
+      error_(path.string(), 5, std::current_exception());
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Driver::add_dependencies_(const std::vector<S>& targets, const std::vector<Path>& prerequisites) {
+   for (const S& target : targets) {
+      append_make_path(depfile_, target);
+      depfile_.push_back(' ');
+   }
+   depfile_.back() = ':';
+
+   for (const Path& prerequisite : prerequisites) {
+      depfile_.push_back(' ');
+      append_make_path(depfile_, prerequisite.string());
+   }
+   depfile_.push_back('\n');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Driver::write_depfile_() {
+   Path path = options_.depfile_dest;
+   if (path.is_relative() && !options_.output_path.empty()) {
+      path = options_.output_path;
+      path /= options_.depfile_dest;
+   }
+
+   be_short_verbose() << "Writing dependencies to " << color::fg_gray << path.generic_string() | default_log();
+
+   std::ofstream ofs(path.native(), std::ios::binary);
+   ofs.write(depfile_.data(), (std::streamsize)depfile_.size());
+   ofs.close();
+   if (ofs.fail()) {
+      error_(path.string(), 5, std::make_exception_ptr(std::ios::failure("Error while writing file: " + path.string())));
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Templates are named by their path relative to the search path they were
+/// found in; if there's more than one, the shortest name wins.
+S Driver::bundle_name_(const Path& path) const {
+   Path abs = fs::absolute(path).lexically_normal();
+   Path name;
+   for (const Path& search_path : options_.search_paths) {
+      Path relative = abs.lexically_relative(fs::absolute(search_path).lexically_normal());
+      if (relative.empty() || *relative.begin() == "..") {
+         continue;
+      }
+      if (name.empty() || relative.native().size() < name.native().size()) {
+         name = relative;
+      }
+   }
+
+   if (name.empty()) {
+      name = path.filename();
+   }
+
+   name.replace_extension();
+   return name.generic_string();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Names the Lua chunk generated for a task, as it appears in Lua error
+/// messages and debug information.
+S Driver::chunk_name_(const Task& task) const {
+   switch (task.job.source_type) {
+      case SourceType::path:    return "@" + task.path.generic_string();
+      case SourceType::console:
+      case SourceType::frames:  return "=stdin";
+      default:                  return "=input";
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Driver::Artifact Driver::primary_artifact_() const {
+   for (std::size_t i = 0; i < options_.emit.size(); ++i) {
+      if (options_.emit[i]) {
+         return (Artifact)i;
+      }
+   }
+   return Artifact::lua;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// The primary (first emitted) artifact goes to the job's destination.  Other
+/// artifacts go to the path given with their own output option, or next to
+/// the primary output with their own extension.  Outputs for a variant are
+/// then renamed according to options_.variant_pattern.
+Driver::DestType Driver::artifact_dest_(const Job& job, Artifact artifact, S& dest, const Variant* variant) const {
+   DestType dest_type = DestType::path;
+   const S& artifact_dest = job.artifact_dests[(std::size_t)artifact];
+   if (!artifact_dest.empty()) {
+      Path path = artifact_dest;
+      if (path.is_relative() && !options_.output_path.empty()) {
+         path = options_.output_path;
+         path /= artifact_dest;
+      }
+      dest = path.string();
+   } else {
+      dest = job.dest;
+      if (artifact == primary_artifact_() || job.dest_type == DestType::console) {
+         dest_type = job.dest_type;
+      } else {
+         Path path = dest;
+         path.replace_extension(artifact_extension(artifact));
+         dest = path.string();
+      }
+   }
+
+   if (variant && artifact != Artifact::tree && dest_type == DestType::path) {
+      Path path = dest;
+      S ext = path.extension().string();
+      if (!ext.empty()) {
+         ext.erase(0, 1);
+      }
+
+      S name = expand_variant_pattern(options_.variant_pattern, path.stem().string(), ext, variant->name);
+      dest = (path.parent_path() / name).string();
+   }
+
+   return dest_type;
+}
+
+} // be::bltc
+} // be
@@ -0,0 +1,170 @@
+#include "framing.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace be {
+namespace bltc {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// Duplicates the stdout file descriptor, then points stdout at stderr.
+int take_stdout() {
+   std::cout.flush();
+   std::fflush(stdout);
+#ifdef _WIN32
+   int fd = _dup(_fileno(stdout));
+   if (fd < 0 || _dup2(_fileno(stderr), _fileno(stdout)) != 0) {
+#else
+   int fd = dup(fileno(stdout));
+   if (fd < 0 || dup2(fileno(stderr), fileno(stdout)) < 0) {
+#endif
+      throw std::system_error(errno, std::generic_category(), "Could not redirect stdout");
+   }
+   return fd;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void restore_stdout(int fd) {
+   std::cout.flush();
+   std::fflush(stdout);
+#ifdef _WIN32
+   _dup2(fd, _fileno(stdout));
+   _close(fd);
+#else
+   dup2(fd, fileno(stdout));
+   close(fd);
+#endif
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Reads the next frame, replacing the contents of payload.
+///
+/// \details Returns false if the stream ends before a new frame starts.
+///         Throws std::ios::failure if it ends partway through a frame or
+///         the frame is too large.
+bool read_frame(std::istream& is, S& payload) {
+   char header[4];
+   is.read(header, sizeof(header));
+   if (is.gcount() == 0 && is.eof()) {
+      return false;
+   }
+   if (is.gcount() != (std::streamsize)sizeof(header)) {
+      throw std::ios::failure("Incomplete frame header");
+   }
+
+   U32 size = read_u32(S(header, sizeof(header)), 0);
+   if (size > max_frame_size) {
+      throw std::ios::failure("Frame too large: " + std::to_string(size) + " bytes");
+   }
+
+   payload.resize(size);
+   if (size > 0) {
+      is.read(&payload[0], size);
+      if (is.gcount() != (std::streamsize)size) {
+         throw std::ios::failure("Incomplete frame");
+      }
+   }
+   return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Writes payload as a single frame and flushes the stream.
+void write_frame(std::ostream& os, const S& payload) {
+   if (payload.size() > max_frame_size) {
+      throw std::ios::failure("Frame too large: " + std::to_string(payload.size()) + " bytes");
+   }
+
+   S header;
+   append_u32(header, (U32)payload.size());
+   os.write(header.data(), (std::streamsize)header.size());
+   os.write(payload.data(), (std::streamsize)payload.size());
+   os.flush();
+   if (!os) {
+      throw std::ios::failure("Error while writing frame");
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void append_u32(S& out, U32 value) {
+   for (int i = 0; i < 4; ++i) {
+      out.push_back((char)(U8)(value >> (8 * i)));
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+U32 read_u32(const S& data, std::size_t offset) {
+   U32 value = 0;
+   for (int i = 0; i < 4; ++i) {
+      value |= (U32)(U8)data[offset + i] << (8 * i);
+   }
+   return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Stops the C runtime from translating line endings on stdin and
+///         stdout, which would corrupt binary frames.
+void set_binary_stdio() {
+#ifdef _WIN32
+   _setmode(_fileno(stdin), _O_BINARY);
+   _setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+FrameOutput::FrameOutput()
+   : fd_(take_stdout()),
+     buf_(fd_),
+     os_(&buf_) { }
+
+///////////////////////////////////////////////////////////////////////////////
+FrameOutput::~FrameOutput() {
+   os_.flush();
+   restore_stdout(fd_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+FrameOutput::Buffer::int_type FrameOutput::Buffer::overflow(int_type c) {
+   if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+   }
+   char ch = traits_type::to_char_type(c);
+   return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Frames are already assembled in memory, so writes go straight to the
+/// file descriptor without further buffering.
+std::streamsize FrameOutput::Buffer::xsputn(const char* s, std::streamsize n) {
+   std::streamsize written = 0;
+   while (written < n) {
+#ifdef _WIN32
+      int result = _write(fd_, s + written, (unsigned)std::min<std::streamsize>(n - written, 1 << 30));
+#else
+      ssize_t result = write(fd_, s + written, (std::size_t)(n - written));
+#endif
+      if (result < 0 && errno == EINTR) {
+         continue;
+      }
+      if (result <= 0) {
+         break;
+      }
+      written += result;
+   }
+   return written;
+}
+
+} // be::bltc
+} // be
@@ -0,0 +1,412 @@
+#include "lua_lexer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace be {
+namespace bltc {
+namespace {
+
+const char* const keywords[] = {
+   "and", "break", "do", "else", "elseif", "end", "false", "for", "function", "goto", "if", "in",
+   "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while"
+};
+
+const char* const symbols3[] = { "..." };
+const char* const symbols2[] = { "..", "==", "~=", "<=", ">=", "::", "//", "<<", ">>" };
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_space(char c) {
+   return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_name_start(char c) {
+   return std::isalpha((unsigned char)c) || c == '_';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_name_char(char c) {
+   return std::isalnum((unsigned char)c) || c == '_';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_digit(char c) {
+   return c >= '0' && c <= '9';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+[[noreturn]] void lex_error(const S& source, std::size_t offset, const char* msg) {
+   std::size_t line = count_newlines(source, 0, std::min(offset, source.size())) + 1;
+   throw std::runtime_error("Lua lexer error on line " + std::to_string(line) + ": " + msg);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Returns the level of the long bracket starting at offset, or -1 if there
+/// is no long bracket there.
+int long_bracket_level(const S& source, std::size_t offset) {
+   if (offset >= source.size() || source[offset] != '[') {
+      return -1;
+   }
+
+   std::size_t i = offset + 1;
+   while (i < source.size() && source[i] == '=') {
+      ++i;
+   }
+
+   if (i < source.size() && source[i] == '[') {
+      return (int)(i - offset - 1);
+   }
+
+   return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Returns the offset just past the long bracket closing the one at offset.
+std::size_t skip_long_bracket(const S& source, std::size_t offset, int level) {
+   S close(level + 2, '=');
+   close.front() = ']';
+   close.back() = ']';
+
+   std::size_t end = source.find(close, offset + level + 2);
+   if (end == S::npos) {
+      lex_error(source, offset, "unfinished long string or comment");
+   }
+
+   return end + close.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::size_t skip_newline(const S& source, std::size_t offset) {
+   char c = source[offset++];
+   if (offset < source.size() && (source[offset] == '\n' || source[offset] == '\r') && source[offset] != c) {
+      ++offset;
+   }
+   return offset;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::size_t skip_quoted_string(const S& source, std::size_t offset) {
+   const char quote = source[offset];
+   const std::size_t n = source.size();
+   std::size_t i = offset + 1;
+   for (;;) {
+      if (i >= n) {
+         lex_error(source, offset, "unfinished string");
+      }
+
+      char c = source[i];
+      if (c == quote) {
+         return i + 1;
+      } else if (c == '\\') {
+         ++i;
+         if (i >= n) {
+            lex_error(source, offset, "unfinished string");
+         }
+         c = source[i];
+         if (c == '\n' || c == '\r') {
+            i = skip_newline(source, i);
+         } else if (c == 'z') {
+            ++i;
+            while (i < n && is_space(source[i])) {
+               ++i;
+            }
+         } else {
+            ++i;
+         }
+      } else if (c == '\n' || c == '\r') {
+         lex_error(source, offset, "unfinished string");
+      } else {
+         ++i;
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void append_utf8(S& out, U32 cp) {
+   if (cp < 0x80) {
+      out.push_back((char)cp);
+   } else if (cp < 0x800) {
+      out.push_back((char)(0xC0 | (cp >> 6)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+   } else if (cp < 0x10000) {
+      out.push_back((char)(0xE0 | (cp >> 12)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+   } else {
+      out.push_back((char)(0xF0 | (cp >> 18)));
+      out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int hex_value(char c) {
+   if (c >= '0' && c <= '9') return c - '0';
+   if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+   return -1;
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Splits Lua source code into tokens.
+///
+/// \details Accepts the union of Lua 5.1-5.3 and LuaJIT lexical syntax.
+///         Throws std::runtime_error if the source contains an unfinished
+///         string or comment.
+std::vector<LuaToken> lex_lua(const S& source) {
+   std::vector<LuaToken> tokens;
+   const std::size_t n = source.size();
+   std::size_t i = 0;
+
+   if (n > 0 && source[0] == '#') {
+      i = std::min(source.find('\n'), n);
+   }
+
+   for (;;) {
+      std::size_t trivia = tokens.empty() ? 0 : tokens.back().end;
+
+      while (i < n) {
+         char c = source[i];
+         if (is_space(c)) {
+            ++i;
+         } else if (c == '-' && i + 1 < n && source[i + 1] == '-') {
+            i += 2;
+            int level = long_bracket_level(source, i);
+            if (level >= 0) {
+               i = skip_long_bracket(source, i, level);
+            } else {
+               i = std::min(source.find('\n', i), n);
+            }
+         } else {
+            break;
+         }
+      }
+
+      if (i >= n) {
+         break;
+      }
+
+      LuaToken token;
+      token.trivia = trivia;
+      token.begin = i;
+
+      char c = source[i];
+      int level;
+      if (is_name_start(c)) {
+         while (i < n && is_name_char(source[i])) {
+            ++i;
+         }
+         token.type = LuaTokenType::name;
+         for (const char* keyword : keywords) {
+            std::size_t len = std::strlen(keyword);
+            if (len == i - token.begin && source.compare(token.begin, len, keyword) == 0) {
+               token.type = LuaTokenType::keyword;
+               break;
+            }
+         }
+      } else if (is_digit(c) || (c == '.' && i + 1 < n && is_digit(source[i + 1]))) {
+         bool hex = c == '0' && i + 1 < n && (source[i + 1] == 'x' || source[i + 1] == 'X');
+         i += hex ? 2 : 1;
+         while (i < n) {
+            char d = source[i];
+            char prev = (char)std::tolower((unsigned char)source[i - 1]);
+            if (is_name_char(d) || d == '.') {
+               ++i;
+            } else if ((d == '+' || d == '-') && prev == (hex ? 'p' : 'e')) {
+               ++i;
+            } else {
+               break;
+            }
+         }
+         token.type = LuaTokenType::number;
+      } else if (c == '"' || c == '\'') {
+         i = skip_quoted_string(source, i);
+         token.type = LuaTokenType::string;
+      } else if ((level = long_bracket_level(source, i)) >= 0) {
+         i = skip_long_bracket(source, i, level);
+         token.type = LuaTokenType::string;
+      } else {
+         std::size_t len = 1;
+         for (const char* symbol : symbols3) {
+            if (source.compare(i, 3, symbol) == 0) {
+               len = 3;
+            }
+         }
+         if (len == 1) {
+            for (const char* symbol : symbols2) {
+               if (source.compare(i, 2, symbol) == 0) {
+                  len = 2;
+               }
+            }
+         }
+         i += len;
+         token.type = LuaTokenType::symbol;
+      }
+
+      token.end = i;
+      tokens.push_back(token);
+   }
+
+   return tokens;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_token(const S& source, const LuaToken& token, const char* text) {
+   std::size_t len = std::strlen(text);
+   return len == token.end - token.begin && source.compare(token.begin, len, text) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_token(const S& source, const LuaToken& token, const S& text) {
+   return text.size() == token.end - token.begin && source.compare(token.begin, text.size(), text) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+S token_text(const S& source, const LuaToken& token) {
+   return source.substr(token.begin, token.end - token.begin);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Returns the value of a string literal token.
+S decode_lua_string(const S& source, const LuaToken& token) {
+   S value;
+   std::size_t i = token.begin;
+   std::size_t end = token.end;
+
+   int level = long_bracket_level(source, i);
+   if (level >= 0) {
+      i += level + 2;
+      end -= level + 2;
+      if (i < end && (source[i] == '\n' || source[i] == '\r')) {
+         i = skip_newline(source, i);
+      }
+      while (i < end) {
+         char c = source[i];
+         if (c == '\n' || c == '\r') {
+            value.push_back('\n');
+            i = skip_newline(source, i);
+         } else {
+            value.push_back(c);
+            ++i;
+         }
+      }
+      return value;
+   }
+
+   ++i;
+   --end;
+   while (i < end) {
+      char c = source[i++];
+      if (c != '\\') {
+         value.push_back(c);
+         continue;
+      }
+
+      c = source[i];
+      switch (c) {
+         case 'a': value.push_back('\a'); ++i; break;
+         case 'b': value.push_back('\b'); ++i; break;
+         case 'f': value.push_back('\f'); ++i; break;
+         case 'n': value.push_back('\n'); ++i; break;
+         case 'r': value.push_back('\r'); ++i; break;
+         case 't': value.push_back('\t'); ++i; break;
+         case 'v': value.push_back('\v'); ++i; break;
+         case '\n':
+         case '\r':
+            value.push_back('\n');
+            i = skip_newline(source, i);
+            break;
+         case 'z':
+            ++i;
+            while (i < end && is_space(source[i])) {
+               ++i;
+            }
+            break;
+         case 'x': {
+            int hi = i + 1 < end ? hex_value(source[i + 1]) : -1;
+            int lo = i + 2 < end ? hex_value(source[i + 2]) : -1;
+            if (hi < 0 || lo < 0) {
+               lex_error(source, i, "invalid hexadecimal escape sequence");
+            }
+            value.push_back((char)(hi * 16 + lo));
+            i += 3;
+            break;
+         }
+         case 'u': {
+            U32 cp = 0;
+            i += 2;
+            while (i < end && source[i] != '}') {
+               int digit = hex_value(source[i++]);
+               if (digit < 0) {
+                  lex_error(source, i, "invalid UTF-8 escape sequence");
+               }
+               cp = cp * 16 + (U32)digit;
+            }
+            ++i;
+            append_utf8(value, cp);
+            break;
+         }
+         default:
+            if (is_digit(c)) {
+               int byte = 0;
+               for (int digits = 0; digits < 3 && i < end && is_digit(source[i]); ++digits) {
+                  byte = byte * 10 + (source[i++] - '0');
+               }
+               if (byte > 255) {
+                  lex_error(source, i, "decimal escape too large");
+               }
+               value.push_back((char)byte);
+            } else {
+               value.push_back(c);
+               ++i;
+            }
+            break;
+      }
+   }
+
+   return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Appends a double-quoted Lua string literal with the given value.
+///
+/// \details The literal never contains a raw line break, so it always
+///         occupies a single line, and it is valid in every Lua version.
+void append_lua_string(S& out, const S& value) {
+   out.reserve(out.size() + value.size() + 2);
+   out.push_back('"');
+   for (char c : value) {
+      switch (c) {
+         case '\\': out.append("\\\\"); break;
+         case '"':  out.append("\\\""); break;
+         case '\n': out.append("\\n"); break;
+         case '\r': out.append("\\r"); break;
+         case '\t': out.append("\\t"); break;
+         default:
+            if ((unsigned char)c < 0x20 || c == 0x7F) {
+               unsigned char byte = (unsigned char)c;
+               out.push_back('\\');
+               out.push_back((char)('0' + byte / 100));
+               out.push_back((char)('0' + byte / 10 % 10));
+               out.push_back((char)('0' + byte % 10));
+            } else {
+               out.push_back(c);
+            }
+            break;
+      }
+   }
+   out.push_back('"');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::size_t count_newlines(const S& source, std::size_t begin, std::size_t end) {
+   return (std::size_t)std::count(source.begin() + begin, source.begin() + end, '\n');
+}
+
+} // be::bltc
+} // be
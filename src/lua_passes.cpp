@@ -0,0 +1,1129 @@
+#include "lua_passes.hpp"
+#include "lua_lexer.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <map>
+#include <unordered_map>
+
+namespace be {
+namespace bltc {
+namespace {
+
+const std::size_t npos = S::npos;
+
+// Standard library globals which templates read but never define
+const char* const library_globals[] = {
+   "assert", "bit", "coroutine", "error", "getmetatable", "io", "ipairs", "math", "next", "os", "pairs",
+   "pcall", "rawequal", "rawget", "rawlen", "rawset", "select", "setmetatable", "string", "table",
+   "tonumber", "tostring", "type", "unpack", "utf8", "xpcall"
+};
+
+// Stays well clear of the 200-local limit per function, and keeps nested
+// functions clear of the 60-upvalue limit in Lua 5.1 and LuaJIT.
+const std::size_t max_locals = 200;
+const std::size_t reserved_locals = 16;
+const std::size_t max_hoisted = 32;
+
+///////////////////////////////////////////////////////////////////////////////
+/// Tokens of one chunk of generated Lua code, plus a few queries about the
+/// context in which a token appears.  These are purely lexical, so they are
+/// conservative: when in doubt, a pass should leave the code alone.
+class Chunk final {
+public:
+   explicit Chunk(const S& source)
+      : source(source),
+        tokens(lex_lua(source)) { }
+
+   std::size_t size() const {
+      return tokens.size();
+   }
+
+   bool is(std::size_t i, const char* text) const {
+      return i < tokens.size() && is_token(source, tokens[i], text);
+   }
+
+   bool is_type(std::size_t i, LuaTokenType type) const {
+      return i < tokens.size() && tokens[i].type == type;
+   }
+
+   bool is_name(std::size_t i, const S& name) const {
+      return is_type(i, LuaTokenType::name) && is_token(source, tokens[i], name);
+   }
+
+   /// True if token i is preceded by '.' or ':', i.e. it names a field or
+   /// method rather than a variable.
+   bool is_field(std::size_t i) const {
+      return i > 0 && (is(i - 1, ".") || is(i - 1, ":"));
+   }
+
+   /// True if a statement could begin at token i, judging by the token
+   /// before it.
+   bool is_statement_start(std::size_t i) const {
+      if (i == 0) {
+         return true;
+      }
+
+      const LuaToken& prev = tokens[i - 1];
+      switch (prev.type) {
+         case LuaTokenType::name:
+         case LuaTokenType::number:
+         case LuaTokenType::string:
+            return true;
+         case LuaTokenType::keyword:
+            return is(i - 1, "end") || is(i - 1, "do") || is(i - 1, "then") || is(i - 1, "else") ||
+               is(i - 1, "repeat") || is(i - 1, "break") || is(i - 1, "true") || is(i - 1, "false") ||
+               is(i - 1, "nil");
+         default:
+            return is(i - 1, ";") || is(i - 1, ")") || is(i - 1, "]") || is(i - 1, "}") || is(i - 1, "...");
+      }
+   }
+
+   /// True if token i could continue a prefix expression ending just before
+   /// it (call, index, or method call).
+   bool is_suffix(std::size_t i) const {
+      return is(i, "(") || is(i, "[") || is(i, ".") || is(i, ":") || is(i, "{") || is_type(i, LuaTokenType::string);
+   }
+
+   /// True if name is ever declared as a local, parameter, or loop variable,
+   /// or is ever the target of an assignment or function definition.
+   bool is_bound(const S& name) const {
+      for (std::size_t i = 0; i < tokens.size(); ++i) {
+         if (is_name(i, name) && !is_field(i) && (is_declaration_(i) || is_assignment_(i))) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   /// True if name is ever declared as a local, parameter, or loop variable.
+   bool is_declared(const S& name) const {
+      for (std::size_t i = 0; i < tokens.size(); ++i) {
+         if (is_name(i, name) && !is_field(i) && is_declaration_(i)) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   /// If token i begins a statement calling writer with a single string
+   /// literal argument, returns the index of the last token of the call and
+   /// sets literal to the index of the argument.  Otherwise returns npos.
+   std::size_t match_literal_write(std::size_t i, const S& writer, std::size_t& literal) const {
+      if (!is_name(i, writer) || !is_statement_start(i)) {
+         return npos;
+      }
+
+      std::size_t last;
+      if (is(i + 1, "(") && is_type(i + 2, LuaTokenType::string) && is(i + 3, ")")) {
+         literal = i + 2;
+         last = i + 3;
+      } else if (is_type(i + 1, LuaTokenType::string)) {
+         literal = i + 1;
+         last = i + 1;
+      } else {
+         return npos;
+      }
+
+      if (is_suffix(last + 1)) {
+         return npos;
+      }
+
+      return last;
+   }
+
+   /// True if string literal i can be replaced by an index expression.  If
+   /// it's a call argument (e.g. f "...") the replacement must be wrapped in
+   /// parentheses, which Lua 5.1 rejects as ambiguous when they start a new
+   /// line, so such literals are only replaceable on the same line as the
+   /// function expression.
+   bool is_replaceable_literal(std::size_t i, bool& parens) const {
+      if (!is_type(i, LuaTokenType::string)) {
+         return false;
+      }
+
+      parens = i > 0 && (is_type(i - 1, LuaTokenType::name) || is_type(i - 1, LuaTokenType::string) ||
+                         is(i - 1, ")") || is(i - 1, "]") || is(i - 1, "}"));
+      if (parens && count_newlines(source, tokens[i - 1].end, tokens[i].begin) > 0) {
+         return false;
+      }
+      return true;
+   }
+
+   /// An upper bound on the number of locals any one function in the chunk
+   /// declares: every local, loop variable, and local function is counted,
+   /// no matter which function it belongs to.
+   std::size_t count_locals() const {
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < tokens.size(); ++i) {
+         if (is(i, "local") || is(i, "for")) {
+            std::size_t j = i + 1;
+            if (is(j, "function")) {
+               ++j;
+            }
+            while (is_type(j, LuaTokenType::name)) {
+               ++count;
+               if (!is(j + 1, ",")) {
+                  break;
+               }
+               j += 2;
+            }
+         }
+      }
+      return count;
+   }
+
+   const S& source;
+   std::vector<LuaToken> tokens;
+
+private:
+   bool is_declaration_(std::size_t i) const {
+      std::size_t j = i;
+      while (j >= 2 && is(j - 1, ",") && is_type(j - 2, LuaTokenType::name)) {
+         j -= 2;
+      }
+
+      if (j == 0) {
+         return false;
+      }
+
+      --j;
+      if (is(j, "local") || is(j, "for") || is(j, "function")) {
+         return true;
+      }
+
+      if (is(j, "(")) {
+         while (j > 0 && (is_type(j - 1, LuaTokenType::name) || is(j - 1, ".") || is(j - 1, ":"))) {
+            --j;
+         }
+         return j > 0 && is(j - 1, "function");
+      }
+
+      return false;
+   }
+
+   bool is_assignment_(std::size_t i) const {
+      if (i > 0 && is(i - 1, "{")) {
+         return false; // table constructor key
+      }
+
+      std::size_t j = i + 1;
+      while (is(j, ",") && is_type(j + 1, LuaTokenType::name)) {
+         j += 2;
+      }
+      return is(j, "=");
+   }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Collects replacements of token ranges and applies them all at once.  Line
+/// breaks inside a replaced range are kept, so every untouched token stays on
+/// the same line it was on in the original source.
+class Rewriter final {
+public:
+   explicit Rewriter(const Chunk& chunk)
+      : chunk_(chunk) { }
+
+   void replace(std::size_t first, std::size_t last, S text) {
+      edits_.push_back({ first, last, std::move(text) });
+   }
+
+   void apply(S& out) {
+      const S& source = chunk_.source;
+      out.clear();
+      out.reserve(source.size());
+
+      std::stable_sort(edits_.begin(), edits_.end(), [](const Edit& a, const Edit& b) { return a.first < b.first; });
+
+      std::size_t offset = 0;
+      for (const Edit& edit : edits_) {
+         std::size_t begin = chunk_.tokens[edit.first].begin;
+         std::size_t end = chunk_.tokens[edit.last].end;
+         out.append(source, offset, begin - offset);
+         out.append(edit.text);
+
+         std::size_t removed = count_newlines(source, begin, end);
+         std::size_t added = count_newlines(edit.text, 0, edit.text.size());
+         if (removed > added) {
+            out.append(removed - added, '\n');
+         }
+         offset = end;
+      }
+      out.append(source, offset, S::npos);
+   }
+
+private:
+   struct Edit {
+      std::size_t first;
+      std::size_t last;
+      S text;
+   };
+
+   const Chunk& chunk_;
+   std::vector<Edit> edits_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// A value that is known when the chunk is compiled, or unknown.
+struct Constant {
+   enum class Type { unknown, nil, boolean, number, string };
+
+   Type type = Type::unknown;
+   bool boolean = false;
+   double number = 0;
+   S string;
+
+   bool known() const {
+      return type != Type::unknown;
+   }
+
+   bool truthy() const {
+      return type != Type::nil && (type != Type::boolean || boolean);
+   }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+Constant make_boolean(bool value) {
+   Constant c;
+   c.type = Constant::Type::boolean;
+   c.boolean = value;
+   return c;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Evaluates expressions made only of literals, parentheses, and the not,
+/// and, or, unary minus, and comparison operators.  Anything else is
+/// unknown, but since and/or short-circuit, an unknown operand doesn't make
+/// the result unknown if it would never be evaluated (e.g. false and f()).
+class ConstantEvaluator final {
+public:
+   explicit ConstantEvaluator(const Chunk& chunk)
+      : chunk_(chunk) { }
+
+   /// Evaluates tokens [first, last).
+   Constant eval(std::size_t first, std::size_t last) const {
+      for (std::size_t i = first; i < last; ++i) {
+         if (chunk_.is(i, "function")) {
+            return Constant();
+         }
+      }
+      return or_(first, last);
+   }
+
+private:
+   using Range = std::pair<std::size_t, std::size_t>;
+
+   /// Splits [first, last) at operators outside any brackets.  Returns false
+   /// if the brackets aren't balanced.
+   bool split_(std::size_t first, std::size_t last, const char* const* ops, std::size_t op_count,
+               std::vector<Range>& operands, std::vector<std::size_t>& operators) const {
+      std::size_t depth = 0;
+      std::size_t begin = first;
+      for (std::size_t i = first; i < last; ++i) {
+         if (chunk_.is(i, "(") || chunk_.is(i, "[") || chunk_.is(i, "{")) {
+            ++depth;
+         } else if (chunk_.is(i, ")") || chunk_.is(i, "]") || chunk_.is(i, "}")) {
+            if (depth == 0) {
+               return false;
+            }
+            --depth;
+         } else if (depth == 0) {
+            for (std::size_t o = 0; o < op_count; ++o) {
+               if (chunk_.is(i, ops[o])) {
+                  operands.push_back({ begin, i });
+                  operators.push_back(i);
+                  begin = i + 1;
+                  break;
+               }
+            }
+         }
+      }
+      operands.push_back({ begin, last });
+      return depth == 0;
+   }
+
+   Constant or_(std::size_t first, std::size_t last) const {
+      static const char* const ops[] = { "or" };
+      std::vector<Range> operands;
+      std::vector<std::size_t> operators;
+      if (!split_(first, last, ops, 1, operands, operators)) {
+         return Constant();
+      }
+
+      Constant value;
+      for (const Range& operand : operands) {
+         value = and_(operand.first, operand.second);
+         if (!value.known() || value.truthy()) {
+            return value;
+         }
+      }
+      return value;
+   }
+
+   Constant and_(std::size_t first, std::size_t last) const {
+      static const char* const ops[] = { "and" };
+      std::vector<Range> operands;
+      std::vector<std::size_t> operators;
+      if (!split_(first, last, ops, 1, operands, operators)) {
+         return Constant();
+      }
+
+      Constant value;
+      for (const Range& operand : operands) {
+         value = compare_(operand.first, operand.second);
+         if (!value.known() || !value.truthy()) {
+            return value;
+         }
+      }
+      return value;
+   }
+
+   Constant compare_(std::size_t first, std::size_t last) const {
+      static const char* const ops[] = { "==", "~=", "<=", ">=", "<", ">" };
+      std::vector<Range> operands;
+      std::vector<std::size_t> operators;
+      if (!split_(first, last, ops, 6, operands, operators)) {
+         return Constant();
+      }
+
+      Constant value = unary_(operands[0].first, operands[0].second);
+      for (std::size_t i = 0; i < operators.size() && value.known(); ++i) {
+         Constant rhs = unary_(operands[i + 1].first, operands[i + 1].second);
+         if (!rhs.known()) {
+            return Constant();
+         }
+
+         std::size_t op = operators[i];
+         if (chunk_.is(op, "==") || chunk_.is(op, "~=")) {
+            value = make_boolean(equal_(value, rhs) == chunk_.is(op, "=="));
+         } else if (value.type == Constant::Type::number && rhs.type == Constant::Type::number) {
+            value = make_boolean(chunk_.is(op, "<") ? value.number < rhs.number :
+                                 chunk_.is(op, ">") ? value.number > rhs.number :
+                                 chunk_.is(op, "<=") ? value.number <= rhs.number : value.number >= rhs.number);
+         } else if (value.type == Constant::Type::string && rhs.type == Constant::Type::string) {
+            int result = value.string.compare(rhs.string);
+            value = make_boolean(chunk_.is(op, "<") ? result < 0 :
+                                 chunk_.is(op, ">") ? result > 0 :
+                                 chunk_.is(op, "<=") ? result <= 0 : result >= 0);
+         } else {
+            return Constant(); // an error at runtime; leave it to happen there
+         }
+      }
+      return value;
+   }
+
+   Constant unary_(std::size_t first, std::size_t last) const {
+      if (first >= last) {
+         return Constant();
+      }
+
+      if (chunk_.is(first, "not")) {
+         Constant value = unary_(first + 1, last);
+         return value.known() ? make_boolean(!value.truthy()) : value;
+      }
+
+      if (chunk_.is(first, "-")) {
+         Constant value = unary_(first + 1, last);
+         if (value.type != Constant::Type::number) {
+            return Constant();
+         }
+         value.number = -value.number;
+         return value;
+      }
+
+      if (chunk_.is(first, "(") && chunk_.is(last - 1, ")") && last - first > 2) {
+         std::vector<Range> operands;
+         std::vector<std::size_t> operators;
+         if (split_(first + 1, last - 1, nullptr, 0, operands, operators)) {
+            return or_(first + 1, last - 1);
+         }
+         return Constant();
+      }
+
+      if (last - first != 1) {
+         return Constant();
+      }
+
+      Constant value;
+      const LuaToken& token = chunk_.tokens[first];
+      if (chunk_.is(first, "nil")) {
+         value.type = Constant::Type::nil;
+      } else if (chunk_.is(first, "true") || chunk_.is(first, "false")) {
+         value = make_boolean(chunk_.is(first, "true"));
+      } else if (token.type == LuaTokenType::number) {
+         S text = token_text(chunk_.source, token);
+         char* end = nullptr;
+         double number = std::strtod(text.c_str(), &end);
+         if (end == text.c_str() + text.size()) {
+            value.type = Constant::Type::number;
+            value.number = number;
+         }
+      } else if (token.type == LuaTokenType::string) {
+         value.type = Constant::Type::string;
+         value.string = decode_lua_string(chunk_.source, token);
+      }
+      return value;
+   }
+
+   static bool equal_(const Constant& a, const Constant& b) {
+      if (a.type != b.type) {
+         return false;
+      }
+      switch (a.type) {
+         case Constant::Type::boolean: return a.boolean == b.boolean;
+         case Constant::Type::number:  return a.number == b.number;
+         case Constant::Type::string:  return a.string == b.string;
+         default:                      return true;
+      }
+   }
+
+   const Chunk& chunk_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// One if, elseif, or else clause: the index of its keyword and of the
+/// 'then' ending its condition (the same as keyword for else).
+struct IfClause {
+   std::size_t keyword;
+   std::size_t then;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Finds the clauses and the matching 'end' of the if statement starting at
+/// token i.  Returns false if the statement can't be matched, or if any
+/// condition contains a function body.
+bool match_if(const Chunk& chunk, std::size_t i, std::vector<IfClause>& clauses, std::size_t& end) {
+   clauses.clear();
+   std::size_t depth = 0;
+   for (std::size_t j = i; j < chunk.size(); ++j) {
+      if (j == i || (depth == 1 && chunk.is(j, "elseif"))) {
+         std::size_t then = j + 1;
+         while (then < chunk.size() && !chunk.is(then, "then")) {
+            if (chunk.is(then, "function")) {
+               return false;
+            }
+            ++then;
+         }
+         if (then >= chunk.size()) {
+            return false;
+         }
+         clauses.push_back({ j, then });
+         depth = 1;
+         j = then;
+      } else if (depth == 1 && chunk.is(j, "else")) {
+         clauses.push_back({ j, j });
+      } else if (chunk.is(j, "if") || chunk.is(j, "function") || chunk.is(j, "do") || chunk.is(j, "repeat")) {
+         ++depth;
+      } else if (chunk.is(j, "end") || chunk.is(j, "until")) {
+         if (--depth == 0) {
+            end = j;
+            return chunk.is(j, "end");
+         }
+      }
+   }
+   return false;
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Replaces references to defined globals with their values, then
+///         removes if/elseif/else clauses that can never run.
+///
+/// \details defines maps global names to Lua literals.  A name is only
+///         replaced where it's read as a plain value; names that are ever
+///         declared or assigned in the chunk are left alone.  A clause is
+///         removed when its condition, after replacement, is a constant
+///         expression (see ConstantEvaluator) that is false, or when an
+///         earlier condition is constant and true; a clause that's certain to
+///         run becomes a do ... end block.  Line numbers are preserved.
+void apply_defines(const S& source, S& out, const std::vector<std::pair<S, S>>& defines) {
+   S substituted;
+   {
+      Chunk chunk(source);
+      std::unordered_map<S, const S*> values;
+      for (const auto& define : defines) {
+         if (!chunk.is_bound(define.first)) {
+            values[define.first] = &define.second;
+         }
+      }
+
+      Rewriter rewriter(chunk);
+      for (std::size_t i = 0; i < chunk.size() && !values.empty(); ++i) {
+         if (!chunk.is_type(i, LuaTokenType::name) || chunk.is_field(i) ||
+             chunk.is(i - 1, "goto") || chunk.is(i - 1, "::") ||
+             chunk.is(i + 1, "=") || chunk.is_suffix(i + 1)) {
+            continue;
+         }
+
+         auto it = values.find(token_text(source, chunk.tokens[i]));
+         if (it != values.end()) {
+            rewriter.replace(i, i, *it->second);
+         }
+      }
+      rewriter.apply(substituted);
+   }
+
+   Chunk chunk(substituted);
+   ConstantEvaluator evaluator(chunk);
+   Rewriter rewriter(chunk);
+   std::map<std::size_t, std::size_t> removed; // first token -> last token
+   std::vector<IfClause> clauses;
+   for (std::size_t i = 0; i < chunk.size(); ++i) {
+      auto skip = removed.find(i);
+      if (skip != removed.end()) {
+         i = skip->second;
+         continue;
+      }
+
+      std::size_t end;
+      if (!chunk.is(i, "if") || !match_if(chunk, i, clauses, end)) {
+         continue;
+      }
+
+      // kept clauses, and whether the last one kept is certain to run
+      std::vector<std::size_t> kept;
+      bool certain = false;
+      bool changed = false;
+      for (std::size_t c = 0; c < clauses.size() && !certain; ++c) {
+         const IfClause& clause = clauses[c];
+         Constant condition;
+         if (clause.keyword == clause.then) {
+            condition = make_boolean(true);
+         } else {
+            condition = evaluator.eval(clause.keyword + 1, clause.then);
+            changed = changed || condition.known();
+         }
+
+         if (!condition.known()) {
+            kept.push_back(c);
+         } else if (condition.truthy()) {
+            kept.push_back(c);
+            certain = true;
+         }
+      }
+
+      if (!changed) {
+         continue;
+      }
+
+      auto clause_end = [&](std::size_t c) {
+         return c + 1 < clauses.size() ? clauses[c + 1].keyword - 1 : end - 1;
+      };
+      auto remove = [&](std::size_t first, std::size_t last, S text) {
+         rewriter.replace(first, last, std::move(text));
+         removed[first] = last;
+      };
+
+      if (kept.empty()) {
+         remove(i, end, "do end"); // a statement is still needed here, e.g. before a '('
+      } else {
+         std::size_t first = kept.front();
+         if (certain && kept.size() == 1) {
+            remove(i, clauses[first].then, "do");
+         } else if (first > 0) {
+            remove(i, clauses[first].keyword, "if");
+         }
+
+         for (std::size_t k = 1; k < kept.size(); ++k) {
+            std::size_t c = kept[k];
+            if (c > kept[k - 1] + 1) {
+               remove(clauses[kept[k - 1] + 1].keyword, clauses[c].keyword - 1, S());
+            }
+            if (certain && k + 1 == kept.size() && clauses[c].keyword != clauses[c].then) {
+               remove(clauses[c].keyword, clauses[c].then, "else");
+            }
+         }
+
+         std::size_t last = kept.back();
+         if (last + 1 < clauses.size()) {
+            remove(clauses[last + 1].keyword, clause_end(clauses.size() - 1), S());
+         }
+      }
+
+      skip = removed.find(i);
+      if (skip != removed.end()) {
+         i = skip->second;
+      }
+   }
+
+   rewriter.apply(out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Merges runs of consecutive statements that write string literals
+///         into a single write of the concatenated literal.
+///
+/// \details Only calls of the form writer("...") or writer "..." are merged,
+///         and only if writer is never declared or assigned in the chunk.
+void coalesce_writes(const S& source, S& out, const S& writer) {
+   Chunk chunk(source);
+   if (chunk.is_bound(writer)) {
+      out = source;
+      return;
+   }
+
+   Rewriter rewriter(chunk);
+   for (std::size_t i = 0; i < chunk.size(); ) {
+      std::size_t literal;
+      std::size_t last = chunk.match_literal_write(i, writer, literal);
+      if (last == npos) {
+         ++i;
+         continue;
+      }
+
+      std::size_t first = i;
+      std::size_t count = 1;
+      S value = decode_lua_string(source, chunk.tokens[literal]);
+      for (;;) {
+         std::size_t next = last + 1;
+         if (chunk.is(next, ";")) {
+            ++next;
+         }
+
+         std::size_t next_last = chunk.match_literal_write(next, writer, literal);
+         if (next_last == npos) {
+            break;
+         }
+
+         value.append(decode_lua_string(source, chunk.tokens[literal]));
+         last = next_last;
+         ++count;
+      }
+
+      if (count > 1) {
+         S text = writer;
+         text.push_back('(');
+         append_lua_string(text, value);
+         text.push_back(')');
+         rewriter.replace(first, last, std::move(text));
+      }
+
+      i = last + 1;
+   }
+
+   rewriter.apply(out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Binds globals that a chunk reads more than once to locals of the
+///         same name at the top of the chunk.
+///
+/// \details Candidates are the standard library globals and any names in
+///         extra_names.  A candidate is only hoisted if it is never declared
+///         or assigned anywhere in the chunk, and the writer is never hoisted
+///         since emit strategies may replace it while the chunk runs.  Since
+///         the locals shadow the globals, no other code needs to change; the
+///         new declaration is placed on the first line.
+void hoist_globals(const S& source, S& out, const S& writer, const std::vector<S>& extra_names) {
+   Chunk chunk(source);
+
+   std::vector<S> candidates(std::begin(library_globals), std::end(library_globals));
+   candidates.insert(candidates.end(), extra_names.begin(), extra_names.end());
+   std::sort(candidates.begin(), candidates.end());
+   candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+   std::vector<S> hoisted;
+   std::size_t limit = std::min(max_hoisted, max_locals - std::min(max_locals, chunk.count_locals() + reserved_locals));
+   for (const S& name : candidates) {
+      if (hoisted.size() >= limit) {
+         break;
+      }
+
+      if (name == writer) {
+         continue;
+      }
+
+      std::size_t uses = 0;
+      for (std::size_t i = 0; i < chunk.size() && uses < 2; ++i) {
+         if (chunk.is_name(i, name) && !chunk.is_field(i)) {
+            ++uses;
+         }
+      }
+
+      if (uses >= 2 && !chunk.is_bound(name)) {
+         hoisted.push_back(name);
+      }
+   }
+
+   if (hoisted.empty()) {
+      out = source;
+      return;
+   }
+
+   std::size_t offset = 0;
+   if (!source.empty() && source[0] == '#') {
+      offset = std::min(source.find('\n'), source.size() - 1) + 1;
+   }
+
+   out.clear();
+   out.reserve(source.size() + hoisted.size() * 32);
+   out.append(source, 0, offset);
+   out.append("local ");
+   for (std::size_t i = 0; i < hoisted.size(); ++i) {
+      out.append(i == 0 ? "" : ", ").append(hoisted[i]);
+   }
+   out.append(" = ");
+   for (std::size_t i = 0; i < hoisted.size(); ++i) {
+      out.append(i == 0 ? "" : ", ").append(hoisted[i]);
+   }
+   out.append("; ");
+   out.append(source, offset, S::npos);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Rewrites statements calling writer so that output is collected in
+///         a local table and written with a single table.concat.
+///
+/// \details writer("...") becomes an assignment to the next slot of the
+///         table.  Other single-argument writes do the same when the value is
+///         a string or number (converted as table.concat does), and are
+///         otherwise passed to writer after flushing the table.  The table is
+///         also flushed before any other statement that is a function call
+///         and before every return, so output written by called code (such
+///         as included templates) stays in order; functions called inside
+///         expressions are assumed not to write.  The remaining output is
+///         written when the chunk ends, so output buffered since the last
+///         flush is lost if the chunk raises an error.  No closures are
+///         created and writer isn't replaced, and line numbers are kept.
+///
+///         If string_buffer is set, a LuaJIT string.buffer is used in place
+///         of the table whenever the module can be loaded.  require is only
+///         called the first time; after that the module (or false, if it
+///         couldn't be loaded) is found in package.loaded.
+///
+///         Returns false and leaves out unchanged if the chunk declares or
+///         assigns writer, uses writer other than in a call statement,
+///         defines functions (which could write after the chunk returns), or
+///         has too many locals to add the buffer's.
+bool buffer_writes(const S& source, S& out, const S& writer, bool string_buffer) {
+   Chunk chunk(source);
+   if (chunk.is_bound(writer) || chunk.count_locals() + reserved_locals + 8 > max_locals) {
+      return false;
+   }
+
+   auto match = [&](std::size_t j) {
+      std::size_t depth = 0;
+      for (; j < chunk.size(); ++j) {
+         if (chunk.is(j, "(") || chunk.is(j, "[") || chunk.is(j, "{")) {
+            ++depth;
+         } else if (chunk.is(j, ")") || chunk.is(j, "]") || chunk.is(j, "}")) {
+            if (--depth == 0) {
+               return j;
+            }
+         }
+      }
+      return npos;
+   };
+
+   auto append = [&](const S& value) {
+      S text;
+      if (string_buffer) {
+         text.append("if __bltc_sb then __bltc_sb:put(").append(value).append(") else ");
+      }
+      text.append("__bltc_n = __bltc_n + 1; __bltc_buf[__bltc_n] = ").append(value);
+      if (string_buffer) {
+         text.append(" end");
+      }
+      return text;
+   };
+
+   S flush;
+   if (string_buffer) {
+      flush.append("if __bltc_sb then "
+                      "if #__bltc_sb > 0 then __bltc_write(__bltc_sb:tostring()); __bltc_sb:reset() end "
+                   "else ");
+   }
+   flush.append("if __bltc_n > 0 then __bltc_write(__bltc_concat(__bltc_buf, \"\", 1, __bltc_n)); __bltc_n = 0 end");
+   if (string_buffer) {
+      flush.append(" end");
+   }
+   flush.append("; ");
+
+   Rewriter rewriter(chunk);
+   for (std::size_t i = 0; i < chunk.size(); ++i) {
+      if (chunk.is(i, "function")) {
+         return false;
+      }
+
+      if (chunk.is(i, "return")) {
+         rewriter.replace(i, i, flush + "return");
+         continue;
+      }
+
+      if (!chunk.is_type(i, LuaTokenType::name) || chunk.is_field(i)) {
+         continue;
+      }
+
+      bool is_writer = chunk.is_name(i, writer);
+      if (!chunk.is_statement_start(i)) {
+         if (is_writer) {
+            return false;
+         }
+         continue;
+      }
+
+      // find the end of the prefix expression starting at i
+      std::size_t j = i + 1;
+      std::size_t args = npos;
+      std::size_t suffixes = 0;
+      for (;;) {
+         if (chunk.is(j, ".") && chunk.is_type(j + 1, LuaTokenType::name)) {
+            j += 2;
+            args = npos;
+         } else if (chunk.is(j, ":") && chunk.is_type(j + 1, LuaTokenType::name)) {
+            j += 2;
+         } else if (chunk.is(j, "[")) {
+            std::size_t close = match(j);
+            if (close == npos) {
+               return false;
+            }
+            j = close + 1;
+            args = npos;
+         } else if (chunk.is(j, "(") || chunk.is(j, "{")) {
+            std::size_t close = match(j);
+            if (close == npos) {
+               return false;
+            }
+            args = j;
+            j = close + 1;
+         } else if (chunk.is_type(j, LuaTokenType::string)) {
+            args = j;
+            ++j;
+         } else {
+            break;
+         }
+         ++suffixes;
+      }
+
+      bool is_call = args != npos && !chunk.is(j, "=") && !chunk.is(j, ",");
+      if (!is_call) {
+         if (is_writer) {
+            return false;
+         }
+         continue;
+      }
+
+      if (is_writer && suffixes == 1) {
+         std::size_t last = j - 1;
+         if (chunk.is_type(args, LuaTokenType::string)) {
+            if (chunk.tokens[args].end - chunk.tokens[args].begin == 2) {
+               rewriter.replace(i, last, S());
+               continue;
+            }
+            rewriter.replace(i, last, append(token_text(source, chunk.tokens[args])));
+            continue;
+         }
+
+         if (chunk.is(args, "(") && chunk.is_type(args + 1, LuaTokenType::string) && args + 2 == last) {
+            if (chunk.tokens[args + 1].end - chunk.tokens[args + 1].begin == 2) {
+               rewriter.replace(i, last, S());
+               continue;
+            }
+            rewriter.replace(i, last, append(token_text(source, chunk.tokens[args + 1])));
+            continue;
+         }
+
+         bool single = chunk.is(args, "(") && args + 1 < last;
+         for (std::size_t k = args + 1; single && k < last; ++k) {
+            if (chunk.is(k, ",")) {
+               single = false;
+            } else if (chunk.is(k, "(") || chunk.is(k, "[") || chunk.is(k, "{")) {
+               k = match(k);
+            }
+         }
+
+         if (single) {
+            S value = source.substr(chunk.tokens[args + 1].begin, chunk.tokens[last - 1].end - chunk.tokens[args + 1].begin);
+            rewriter.replace(i, last, "do local __bltc_v = " + value + "; local __bltc_t = __bltc_type(__bltc_v); "
+                                      "if __bltc_t == \"string\" or __bltc_t == \"number\" then " + append("__bltc_v") +
+                                      " else " + flush + "__bltc_write(__bltc_v) end end");
+            continue;
+         }
+      } else if (is_writer) {
+         return false;
+      }
+
+      // any other call might write output itself
+      rewriter.replace(i, i, flush + token_text(source, chunk.tokens[i]));
+      i = j - 1;
+   }
+
+   S body;
+   rewriter.apply(body);
+
+   std::size_t offset = 0;
+   if (!body.empty() && body[0] == '#') {
+      offset = std::min(body.find('\n'), body.size() - 1) + 1;
+   }
+
+   out.clear();
+   out.reserve(body.size() + 512);
+   out.append(body, 0, offset);
+   out.append("local __bltc_write, __bltc_type, __bltc_concat, __bltc_buf, __bltc_n");
+   if (string_buffer) {
+      out.append(", __bltc_sb");
+   }
+   out.append(" = ").append(writer).append(", type, table.concat, {}, 0; ");
+   if (string_buffer) {
+      // package.loaded caches a failed require as false, so it only happens once
+      out.append("if package then "
+                    "local m = package.loaded[\"string.buffer\"]; "
+                    "if m == nil then "
+                       "local ok; ok, m = pcall(require, \"string.buffer\"); "
+                       "if not ok or type(m) ~= \"table\" then m = false; package.loaded[\"string.buffer\"] = false end "
+                    "end; "
+                    "if m then __bltc_sb = m.new() end "
+                 "end; ");
+   }
+   out.append("do ");
+   out.append(body, offset, S::npos);
+   out.append("\nend; ").append(flush).append("\n");
+   return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Replaces statements calling include_fn with a single string
+///         literal argument by the code of the included template.
+///
+/// \details load is called with the argument of each such call, and should
+///         set lua to the generated code for that template (with its own
+///         includes already inlined), or return false to leave the call
+///         alone.  The names of included templates which were actually
+///         inlined are appended to inlined.  The included code is spliced in as a do ... end block on
+///         the line of the call, so no other lines move; errors raised by
+///         inlined code report the caller's line.
+///
+///         Only templates which run the same way when spliced into the caller
+///         are inlined: they must not use return, goto, or '...', none of the
+///         names they use may be locals in the caller, and the combined code
+///         must stay well clear of Lua's limit on locals.  This assumes
+///         include_fn runs templates in the caller's environment.
+void inline_includes(const S& source, S& out, const S& include_fn, const std::function<bool(const S&, S&)>& load,
+                     std::vector<S>& inlined) {
+   Chunk chunk(source);
+   if (chunk.is_bound(include_fn)) {
+      out = source;
+      return;
+   }
+
+   Rewriter rewriter(chunk);
+   std::size_t locals = chunk.count_locals();
+   S lua;
+   for (std::size_t i = 0; i < chunk.size(); ++i) {
+      std::size_t literal;
+      std::size_t last = chunk.match_literal_write(i, include_fn, literal);
+      if (last == npos) {
+         continue;
+      }
+
+      S name = decode_lua_string(source, chunk.tokens[literal]);
+      if (!load(name, lua)) {
+         continue;
+      }
+
+      std::unique_ptr<Chunk> included;
+      try {
+         included = std::make_unique<Chunk>(lua);
+      } catch (const std::runtime_error&) {
+         continue;
+      }
+
+      bool ok = locals + included->count_locals() + reserved_locals <= max_locals;
+      for (std::size_t t = 0; t < included->size() && ok; ++t) {
+         if (included->is(t, "return") || included->is(t, "goto") || included->is(t, "::") || included->is(t, "...")) {
+            ok = false;
+         } else if (included->is_type(t, LuaTokenType::name) && !included->is_field(t)) {
+            ok = !chunk.is_declared(token_text(lua, included->tokens[t]));
+         }
+      }
+
+      if (!ok) {
+         continue;
+      }
+
+      S text = "do";
+      for (const LuaToken& token : included->tokens) {
+         text.push_back(' ');
+         if (token.type == LuaTokenType::string) {
+            append_lua_string(text, decode_lua_string(lua, token));
+         } else {
+            text.append(lua, token.begin, token.end - token.begin);
+         }
+      }
+      text.append(" end");
+
+      locals += included->count_locals();
+      rewriter.replace(i, last, std::move(text));
+      inlined.push_back(std::move(name));
+      i = last;
+   }
+
+   rewriter.apply(out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Appends the value of each string literal at least min_length
+///         bytes long that intern_strings() could replace to values.
+void find_strings(const S& source, std::size_t min_length, std::vector<S>& values) {
+   Chunk chunk(source);
+   for (std::size_t i = 0; i < chunk.size(); ++i) {
+      bool parens;
+      if (chunk.is_replaceable_literal(i, parens)) {
+         S value = decode_lua_string(source, chunk.tokens[i]);
+         if (value.size() >= min_length) {
+            values.push_back(std::move(value));
+         }
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Replaces string literals whose values appear in constants with
+///         references to a constant table passed to the chunk.
+///
+/// \details The rewritten chunk must be called with the constant table to
+///         obtain the template's function; constants maps each value to its
+///         (1-based) index in that table.  Line numbers are preserved.
+///
+///         Returns false and leaves out unchanged if no literals were
+///         replaced.
+bool intern_strings(const S& source, S& out, const std::unordered_map<S, std::size_t>& constants, const S& table) {
+   Chunk chunk(source);
+   Rewriter rewriter(chunk);
+   bool replaced = false;
+   for (std::size_t i = 0; i < chunk.size(); ++i) {
+      bool parens;
+      if (!chunk.is_replaceable_literal(i, parens)) {
+         continue;
+      }
+
+      auto it = constants.find(decode_lua_string(source, chunk.tokens[i]));
+      if (it == constants.end()) {
+         continue;
+      }
+
+      S text = table + "[" + std::to_string(it->second) + "]";
+      if (parens) {
+         text = " (" + text + ")";
+      }
+      rewriter.replace(i, i, std::move(text));
+      replaced = true;
+   }
+
+   if (!replaced) {
+      return false;
+   }
+
+   S body;
+   rewriter.apply(body);
+   out.clear();
+   out.reserve(body.size() + table.size() + 40);
+   out.append("local ").append(table).append(" = ...; return function(...) ");
+   out.append(body);
+   out.append("\nend\n");
+   return true;
+}
+
+} // be::bltc
+} // be
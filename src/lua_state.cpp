@@ -0,0 +1,118 @@
+#include "lua_state.hpp"
+#include <lua.hpp>
+#include <new>
+
+namespace be {
+namespace bltc {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+int append_dump(lua_State*, const void* data, std::size_t size, void* ud) {
+   static_cast<S*>(ud)->append(static_cast<const char*>(data), size);
+   return 0;
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+struct LuaState::Allocator {
+   lua_Alloc alloc;
+   void* ud;
+   LuaAllocStats* stats;
+
+   static void* counting_alloc(void* ud, void* ptr, std::size_t osize, std::size_t nsize) {
+      Allocator& self = *static_cast<Allocator*>(ud);
+      // when ptr is null, osize holds the type of object being allocated;
+      // growing a block only counts the bytes it grows by
+      if (nsize > 0 && (!ptr || nsize > osize)) {
+         ++self.stats->allocations;
+         self.stats->bytes += ptr ? nsize - osize : nsize;
+      }
+      return self.alloc(self.ud, ptr, osize, nsize);
+   }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// The standard allocator is wrapped rather than replaced, so the state
+/// keeps the panic handler installed by luaL_newstate().
+LuaState::LuaState(LuaAllocStats* stats)
+   : L_(luaL_newstate()) {
+   if (!L_) {
+      throw std::bad_alloc();
+   }
+
+   if (stats) {
+      allocator_ = std::make_unique<Allocator>();
+      allocator_->alloc = lua_getallocf(L_, &allocator_->ud);
+      allocator_->stats = stats;
+      lua_setallocf(L_, Allocator::counting_alloc, allocator_.get());
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+LuaState::~LuaState() {
+   lua_close(L_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+lua_State* LuaState::get() const {
+   return L_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Opens the Lua standard libraries.
+void LuaState::open_libs() {
+   luaL_openlibs(L_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Parses a chunk of Lua source code and pushes the resulting
+///         function onto the stack.
+///
+/// \details Throws LuaError (leaving the stack unchanged) if the source
+///         can't be parsed.  chunk_name follows the usual Lua conventions:
+///         '@' followed by a file name, or '=' followed by a description.
+void LuaState::load(const S& source, const S& chunk_name) {
+   if (luaL_loadbuffer(L_, source.data(), source.size(), chunk_name.c_str()) != 0) {
+      S msg = lua_tostring(L_, -1) ? lua_tostring(L_, -1) : "unknown error";
+      lua_pop(L_, 1);
+      throw LuaError(msg);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Calls the function below the top nargs values on the stack,
+///         leaving nresults results in its place.
+///
+/// \details Throws LuaError (after popping the function and arguments) if
+///         the function raises an error.
+void LuaState::call(int nargs, int nresults) {
+   if (lua_pcall(L_, nargs, nresults, 0) != 0) {
+      S msg = lua_tostring(L_, -1) ? lua_tostring(L_, -1) : "unknown error";
+      lua_pop(L_, 1);
+      throw LuaError(msg);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Replaces the contents of out with the bytecode for the function on
+///         top of the stack, and pops it.
+///
+/// \details Debug information can only be stripped when linked against
+///         Lua 5.3 or later; otherwise strip is ignored.
+void LuaState::dump(S& out, bool strip) {
+   out.clear();
+#if LUA_VERSION_NUM >= 503
+   int result = lua_dump(L_, append_dump, &out, strip ? 1 : 0);
+#else
+   (void)strip;
+   int result = lua_dump(L_, append_dump, &out);
+#endif
+   lua_pop(L_, 1);
+   if (result != 0) {
+      throw LuaError("Could not dump Lua bytecode");
+   }
+}
+
+} // be::bltc
+} // be
@@ -0,0 +1,132 @@
+#include "renderer.hpp"
+#include <lua.hpp>
+
+namespace be {
+namespace bltc {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// Appends each argument to the current render's output.  Strings and
+/// numbers are written as-is; anything else is passed through tostring.
+int write_output(lua_State* L) {
+   S* out = *static_cast<S**>(lua_touserdata(L, lua_upvalueindex(1)));
+   if (!out) {
+      return luaL_error(L, "output can only be written while a template is rendering");
+   }
+
+   int n = lua_gettop(L);
+   for (int i = 1; i <= n; ++i) {
+      int type = lua_type(L, i);
+      if (type != LUA_TSTRING && type != LUA_TNUMBER) {
+         lua_getglobal(L, "tostring");
+         lua_pushvalue(L, i);
+         lua_call(L, 1, 1);
+         lua_replace(L, i);
+      }
+
+      std::size_t size;
+      const char* str = lua_tolstring(L, i, &size);
+      if (!str) {
+         return luaL_error(L, "'tostring' must return a string to be written");
+      }
+
+      bool failed = false;
+      try {
+         out->append(str, size);
+      } catch (const std::exception&) {
+         // don't let C++ exceptions unwind through Lua
+         failed = true;
+      }
+      if (failed) {
+         return luaL_error(L, "not enough memory");
+      }
+   }
+   return 0;
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+Renderer::Renderer(const RenderOptions& options, LuaAllocStats* stats)
+   : lua_(stats) {
+   lua_State* L = lua_.get();
+   lua_.open_libs();
+
+   lua_pushlightuserdata(L, &out_);
+   lua_pushcclosure(L, write_output, 1);
+   lua_setglobal(L, options.writer.c_str());
+
+   if (!options.data.empty()) {
+      lua_.load(options.data, options.data_chunk_name);
+      lua_.call(0, 1);
+      if (lua_type(L, -1) == LUA_TTABLE) {
+         lua_pushnil(L);
+         while (lua_next(L, -2) != 0) {
+            if (lua_type(L, -2) == LUA_TSTRING) {
+               lua_setglobal(L, lua_tostring(L, -2));
+            } else {
+               lua_pop(L, 1);
+            }
+         }
+      } else if (lua_type(L, -1) != LUA_TNIL) {
+         lua_pop(L, 1);
+         throw LuaError(options.data_chunk_name.substr(1) + ": data must be a table");
+      }
+      lua_pop(L, 1);
+   }
+
+   if (!options.globals.empty()) {
+      S source;
+      for (auto& global : options.globals) {
+         source.append(global.first);
+         source.append(" = ");
+         source.append(global.second);
+         source.push_back('\n');
+      }
+      lua_.load(source, "=globals");
+      lua_.call(0, 0);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+LuaState& Renderer::lua() {
+   return lua_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Parses a compiled template, replacing any previously loaded one.
+///
+/// \details Throws LuaError if the template can't be parsed.
+void Renderer::load(const S& lua, const S& chunk_name) {
+   if (loaded_) {
+      lua_pop(lua_.get(), 1);
+      loaded_ = false;
+   }
+   lua_.load(lua, chunk_name);
+   loaded_ = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Runs the loaded template once, appending its output to out.
+///
+/// \details Throws LuaError if the template raises an error; any output
+///         written before the error remains in out.
+void Renderer::render(S& out) {
+   if (!loaded_) {
+      throw std::logic_error("No template loaded");
+   }
+
+   lua_State* L = lua_.get();
+   lua_pushvalue(L, -1);
+   out_ = &out;
+   try {
+      lua_.call(0, 0);
+   } catch (...) {
+      out_ = nullptr;
+      throw;
+   }
+   out_ = nullptr;
+}
+
+} // be::bltc
+} // be
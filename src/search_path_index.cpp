@@ -0,0 +1,171 @@
+#include "search_path_index.hpp"
+#include <be/util/path_glob.hpp>
+#include <algorithm>
+#include <cctype>
+
+namespace be {
+namespace bltc {
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_plain_pattern(const S& pattern) {
+   if (pattern.find_first_of("*?[]{}") != S::npos) {
+      return false;
+   }
+
+   Path path(pattern);
+   if (path.empty() || path.is_absolute() || path.has_root_name()) {
+      return false;
+   }
+
+   for (auto& part : path) {
+      S str = part.string();
+      if (str == "." || str == "..") {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+S entry_key(S name) {
+#ifdef _WIN32
+   std::transform(name.begin(), name.end(), name.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+#endif
+   return name;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+S dir_key(const Path& dir) {
+   S key = fs::absolute(dir.empty() ? Path(".") : dir).lexically_normal().generic_string();
+   for (;;) {
+      if (key.size() > 1 && key.back() == '/') {
+         key.pop_back();
+      } else if (key.size() > 2 && key.back() == '.' && key[key.size() - 2] == '/') {
+         key.resize(key.size() - 2);
+      } else {
+         return key;
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// The directory part of a pattern before its first wildcard; only files
+/// within it can ever match.
+Path glob_root(const S& pattern) {
+   Path root;
+   for (auto& part : Path(pattern)) {
+      if (part.string().find_first_of("*?[]{}") != S::npos) {
+         return root;
+      }
+      root /= part;
+   }
+   return root.parent_path();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_within(const S& dir, const S& root) {
+   S a = entry_key(dir);
+   S b = entry_key(root);
+   return a.compare(0, b.size(), b) == 0 && (a.size() == b.size() || a[b.size()] == '/' || b.back() == '/');
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+SearchPathIndex::SearchPathIndex(const std::vector<Path>& search_paths)
+   : search_paths_(search_paths) { }
+
+///////////////////////////////////////////////////////////////////////////////
+std::vector<Path> SearchPathIndex::resolve(const S& pattern) {
+   if (!is_plain_pattern(pattern)) {
+      auto it = globs_.find(pattern);
+      if (it == globs_.end()) {
+         it = globs_.emplace(pattern, util::glob(pattern, search_paths_, util::PathMatchType::files_and_misc)).first;
+      }
+      return it->second;
+   }
+
+   std::vector<Path> paths;
+   Path relative(pattern);
+   S name = entry_key(relative.filename().string());
+
+   for (const Path& search_path : search_paths_) {
+      Path dir = search_path;
+      if (relative.has_parent_path()) {
+         dir /= relative.parent_path();
+      }
+
+      const DirEntries& entries = dir_(dir);
+      auto it = entries.find(name);
+      if (it != entries.end() && !it->second) {
+         Path path = search_path;
+         path /= relative;
+         paths.push_back(path);
+      }
+   }
+
+   return paths;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Drops any cached information that a new file in a directory could
+///         make stale.
+///
+/// \details Must be called after a file is created in a directory that may
+///         have been indexed (e.g. when writing output next to an input).
+///         An empty path means the working directory.
+///         Cached glob results are only dropped if the pattern could reach
+///         that directory, so writing outside every search path keeps them.
+void SearchPathIndex::invalidate(const Path& dir) {
+   S key = dir_key(dir);
+   dirs_.erase(key);
+
+   for (auto it = globs_.begin(); it != globs_.end(); ) {
+      Path root = glob_root(it->first);
+      bool reachable = false;
+      if (root.is_absolute()) {
+         reachable = is_within(key, dir_key(root));
+      } else {
+         for (const Path& search_path : search_paths_) {
+            if (is_within(key, dir_key(search_path / root))) {
+               reachable = true;
+               break;
+            }
+         }
+      }
+
+      if (reachable) {
+         it = globs_.erase(it);
+      } else {
+         ++it;
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const SearchPathIndex::DirEntries& SearchPathIndex::dir_(const Path& dir) {
+   S key = dir_key(dir);
+   auto it = dirs_.find(key);
+   if (it != dirs_.end()) {
+      return it->second;
+   }
+
+   DirEntries& entries = dirs_[key];
+   try {
+      if (fs::is_directory(dir)) {
+         for (auto& entry : fs::directory_iterator(dir)) {
+            entries[entry_key(entry.path().filename().string())] = fs::is_directory(entry.status());
+         }
+      }
+   } catch (const fs::filesystem_error&) {
+      // unreadable directories are indexed as empty, the same as util::glob would treat them
+      entries.clear();
+   }
+
+   return entries;
+}
+
+} // be::bltc
+} // be
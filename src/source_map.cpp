@@ -0,0 +1,163 @@
+#include "source_map.hpp"
+#include "lua_lexer.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace be {
+namespace bltc {
+namespace {
+
+// Text and code are only matched this far past the end of the previous match,
+// so that names the BLT compiler adds itself don't skip over the template,
+// and so that each search is bounded.
+const std::size_t max_match_distance = 1024;
+
+///////////////////////////////////////////////////////////////////////////////
+bool is_name_char(char c) {
+   return std::isalnum((unsigned char)c) || c == '_';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Finds value in source, starting no earlier than offset and ending no later
+/// than limit.
+std::size_t find_within(const S& source, const S& value, std::size_t offset, std::size_t limit) {
+   limit = std::min(limit, source.size());
+   if (offset > limit || value.size() > limit - offset) {
+      return S::npos;
+   }
+   auto end = source.begin() + limit;
+   auto found = std::search(source.begin() + offset, end, value.begin(), value.end());
+   return found == end ? S::npos : (std::size_t)(found - source.begin());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::size_t find_text(const S& source, const S& value, std::size_t offset) {
+   std::size_t found = find_within(source, value, offset, offset + max_match_distance + value.size());
+   if (found != S::npos) {
+      return found;
+   }
+
+   // in case the BLT compiler adjusted whitespace, try the first line alone
+   std::size_t begin = value.find_first_not_of(" \t\r\n");
+   if (begin == S::npos) {
+      return S::npos;
+   }
+   std::size_t end = value.find_first_of("\r\n", begin);
+   S first = value.substr(begin, end == S::npos ? S::npos : end - begin);
+   return find_within(source, first, offset, offset + max_match_distance + first.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::size_t find_code(const S& source, const S& text, bool is_word, std::size_t offset) {
+   std::size_t limit = offset + max_match_distance + text.size();
+   for (;;) {
+      std::size_t found = find_within(source, text, offset, limit);
+      if (found == S::npos) {
+         return S::npos;
+      }
+
+      std::size_t end = found + text.size();
+      if (!is_word || ((found == 0 || !is_name_char(source[found - 1])) &&
+                       (end == source.size() || !is_name_char(source[end])))) {
+         return found;
+      }
+      offset = found + 1;
+   }
+}
+
+} // be::bltc::()
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Guesses which part of a template produced each line of the Lua
+///         code the BLT compiler generated for it.
+///
+/// \details lua must be the unmodified output of the BLT compiler; since
+///         optimization passes never move code between lines, the result
+///         also applies to optimized output.  Literal text written with the
+///         writer function is located in the template, as are names,
+///         keywords, numbers and strings from embedded code.  Matches are
+///         found in order, and only within a short distance of the previous
+///         match, so the template must produce code in the same order as its
+///         source.  Each line maps to its first match; lines without one are
+///         left unknown.  The result is a heuristic: repeated text can map to
+///         the wrong occurrence.
+std::vector<SourceLocation> map_source_lines(const S& lua, const S& writer, const S& source) {
+   std::vector<LuaToken> tokens = lex_lua(lua);
+   std::vector<SourceLocation> lines(count_newlines(lua, 0, lua.size()) + 1);
+
+   std::size_t lua_line = 0;
+   std::size_t lua_offset = 0;
+   std::size_t cursor = 0;
+   SourceLocation location { 1, 1 };
+   std::size_t location_offset = 0;
+
+   for (std::size_t i = 0; i < tokens.size(); ++i) {
+      const LuaToken& token = tokens[i];
+      lua_line += count_newlines(lua, lua_offset, token.begin);
+      lua_offset = token.begin;
+
+      std::size_t found = S::npos;
+      std::size_t length = 0;
+      if (token.type == LuaTokenType::name && is_token(lua, token, writer)) {
+         if (i + 3 < tokens.size() && is_token(lua, tokens[i + 1], "(") &&
+             tokens[i + 2].type == LuaTokenType::string && is_token(lua, tokens[i + 3], ")")) {
+            S value = decode_lua_string(lua, tokens[i + 2]);
+            if (!value.empty()) {
+               found = find_text(source, value, cursor);
+               length = found == S::npos ? 0 : std::min(value.size(), source.size() - found);
+            }
+            i += 3;
+         }
+      } else if (token.type != LuaTokenType::symbol) {
+         S text = token_text(lua, token);
+         found = find_code(source, text, token.type != LuaTokenType::string, cursor);
+         length = text.size();
+      }
+
+      if (found == S::npos) {
+         continue;
+      }
+
+      for (; location_offset < found; ++location_offset) {
+         if (source[location_offset] == '\n') {
+            ++location.line;
+            location.column = 1;
+         } else {
+            ++location.column;
+         }
+      }
+
+      if (lines[lua_line].line == 0) {
+         lines[lua_line] = location;
+      }
+      cursor = found + length;
+   }
+
+   return lines;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Writes a source map in bltc's compact text format.
+///
+/// \details The first line is "bltc-source-map 1"; the second is "source "
+///         followed by source_name.  Each following line has the form
+///         "LUA_LINE TEMPLATE_LINE:COLUMN", or "LUA_LINE -" for lines that
+///         couldn't be mapped, and applies to generated lines from LUA_LINE
+///         up to the next entry.  Lines before the first entry don't
+///         correspond to any part of the template either.
+void write_source_map(std::ostream& os, const S& source_name, const std::vector<SourceLocation>& lines) {
+   os << "bltc-source-map 1\nsource " << source_name << '\n';
+   bool mapped = false;
+   for (std::size_t i = 0; i < lines.size(); ++i) {
+      if (lines[i].line != 0) {
+         os << (i + 1) << ' ' << lines[i].line << ':' << lines[i].column << '\n';
+         mapped = true;
+      } else if (mapped) {
+         os << (i + 1) << " -\n";
+         mapped = false;
+      }
+   }
+}
+
+} // be::bltc
+} // be